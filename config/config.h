@@ -1,15 +1,63 @@
 #ifndef LEAF_CONFIG_H
 #define LEAF_CONFIG_H
 
+#include <chrono>
+
 namespace leaf
 {
 constexpr auto kBlockSize = 128 * 1024;
 constexpr auto kHashBlockCount = 10;
+constexpr auto kMinBlockSize = 16 * 1024;
+constexpr auto kMaxBlockSize = 1024 * 1024;
+constexpr auto kMaxAdaptiveBlockSize = 4 * 1024 * 1024;
+constexpr auto kBlockTargetTime = std::chrono::milliseconds(5);
+constexpr auto kDefaultWindow = 16;
+constexpr auto kMaxInflightBytes = 32 * 1024 * 1024;
+constexpr auto kTransferStreams = 8;
+constexpr auto kTransferAging = std::chrono::seconds(30);
+constexpr auto kStripeConnections = 4;
+constexpr auto kStripeMinFileSize = 64 * 1024 * 1024;
+constexpr auto kStripeChunkSize = 32 * 1024 * 1024;
 constexpr auto kDefaultDir = "/tmp";
 constexpr auto kReadWsLimited = 2 * 1024 * 1024;
 constexpr auto kWriteWsLimited = 2 * 1024 * 1024;
+// 每秒字节数, 0 表示不限速
+constexpr auto kGlobalReadLimited = 0;
+constexpr auto kGlobalWriteLimited = 0;
+constexpr auto kGroupReadLimited = 0;
+constexpr auto kGroupWriteLimited = 0;
+constexpr auto kConnectionReadLimited = 0;
+constexpr auto kConnectionWriteLimited = 0;
+constexpr auto kRateQuantum = 16 * 1024;
+// 批量传输连接的 socket 参数, 缓冲区为 0 时使用内核自动调整
+// 显式设置会关闭自动调整, 并且受 net.core.wmem_max / rmem_max 限制, 只在调大这两个值后通过 --socket-buffer 设置
+constexpr auto kBulkSocketBuffer = 0;
+constexpr auto kBulkNotsentLowat = 128 * 1024;
+constexpr auto kBulkCongestion = "bbr";
+constexpr auto kKeepaliveIdle = 30;
+constexpr auto kKeepaliveInterval = 10;
+constexpr auto kKeepaliveCount = 3;
 constexpr auto kTmpFilenameSuffix = ".tmp";
 constexpr auto kLeafFilenameSuffix = ".leaf";
+constexpr auto kCheckpointFilenameSuffix = ".ckpt";
+constexpr auto kObjectsDir = ".objects";
+// 清理不再被任何文件引用的内容对象的间隔
+constexpr auto kContentReclaimInterval = std::chrono::minutes(10);
+constexpr auto kMaxResumeHashes = 8192;
+constexpr auto kMaxDeltaBlocks = 8192;
+constexpr auto kBundleFileSize = 1024 * 1024;
+constexpr auto kBundleMaxFiles = 1024;
+constexpr auto kBundleMaxSize = 64 * 1024 * 1024;
+// 查询目录所在设备的线程数, 与读写线程分开
+constexpr auto kDiskLookupThreadSize = 2;
+// 每个设备的读写线程数, 即同一设备同时执行的操作数
+constexpr auto kDiskQueueDepth = 4;
+constexpr auto kLagProbeInterval = std::chrono::milliseconds(100);
+constexpr auto kMemoryBudget = 512 * 1024 * 1024;
+// 单个连接最多占用的发送缓冲, 不读数据的对端不会耗尽进程预算
+constexpr auto kConnectionMemoryBudget = 64 * 1024 * 1024;
+// 不超过该大小且没有借用数据的消息 (credit, error, keepalive 等) 不占用额度
+constexpr auto kControlFrameSize = 4 * 1024;
 
 }    // namespace leaf
 
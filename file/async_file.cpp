@@ -0,0 +1,168 @@
+#include <memory>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+#include "file/file.h"
+#include "file/async_file.h"
+#include "file/disk_executors.h"
+
+namespace leaf
+{
+#if defined(BOOST_ASIO_HAS_FILE)
+class async_file_impl
+{
+   public:
+    enum class file_operation
+    {
+        read,
+        write
+    };
+
+   public:
+    async_file_impl(const boost::asio::any_io_executor& ex, std::string filename) : filename_(std::move(filename)), file_(ex) {}
+
+    boost::system::error_code open(file_operation op)
+    {
+        auto flags = boost::asio::random_access_file::read_only;
+        if (op == file_operation::write)
+        {
+            flags = boost::asio::random_access_file::read_write | boost::asio::random_access_file::create;
+        }
+        boost::system::error_code ec;
+        ec = file_.open(filename_, flags, ec);
+        return ec;
+    }
+
+    boost::system::error_code close()
+    {
+        boost::system::error_code ec;
+        if (file_.is_open())
+        {
+            ec = file_.close(ec);
+        }
+        return ec;
+    }
+
+    boost::asio::awaitable<std::size_t> read_at(std::int64_t offset, void* buffer, std::size_t size, boost::system::error_code& ec)
+    {
+        auto read_size = co_await file_.async_read_some_at(
+            offset, boost::asio::buffer(buffer, size), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        read_size_ += read_size;
+        co_return read_size;
+    }
+
+    boost::asio::awaitable<std::size_t> write_at(std::int64_t offset, void const* buffer, std::size_t size, boost::system::error_code& ec)
+    {
+        auto write_size = co_await boost::asio::async_write_at(
+            file_, offset, boost::asio::buffer(buffer, size), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        write_size_ += write_size;
+        co_return write_size;
+    }
+
+    std::size_t read_size() const { return read_size_; }
+    std::size_t write_size() const { return write_size_; }
+    std::string name() const { return filename_; }
+
+   private:
+    std::size_t read_size_ = 0;
+    std::size_t write_size_ = 0;
+    std::string filename_;
+    boost::asio::random_access_file file_;
+};
+
+bool async_file_native() { return true; }
+#else
+// 没有异步文件支持的平台在磁盘线程池上同步读写
+class async_file_impl
+{
+   public:
+    enum class file_operation
+    {
+        read,
+        write
+    };
+
+   public:
+    async_file_impl(const boost::asio::any_io_executor& /*ex*/, std::string filename) : filename_(std::move(filename)) {}
+
+    boost::system::error_code open(file_operation op)
+    {
+        if (op == file_operation::write)
+        {
+            writer_ = std::make_unique<leaf::file_writer>(filename_);
+            return writer_->open();
+        }
+        reader_ = std::make_unique<leaf::file_reader>(filename_);
+        return reader_->open();
+    }
+
+    boost::system::error_code close()
+    {
+        if (writer_)
+        {
+            return writer_->close();
+        }
+        if (reader_)
+        {
+            return reader_->close();
+        }
+        return {};
+    }
+
+    boost::asio::awaitable<std::size_t> read_at(std::int64_t offset, void* buffer, std::size_t size, boost::system::error_code& ec)
+    {
+        co_return co_await leaf::dio::instance().run(filename_, [&]() { return reader_->read_at(offset, buffer, size, ec); });
+    }
+
+    boost::asio::awaitable<std::size_t> write_at(std::int64_t offset, void const* buffer, std::size_t size, boost::system::error_code& ec)
+    {
+        co_return co_await leaf::dio::instance().run(filename_, [&]() { return writer_->write_at(offset, buffer, size, ec); });
+    }
+
+    std::size_t read_size() const { return reader_ ? reader_->size() : 0; }
+    std::size_t write_size() const { return writer_ ? writer_->size() : 0; }
+    std::string name() const { return filename_; }
+
+   private:
+    std::string filename_;
+    std::unique_ptr<leaf::file_reader> reader_;
+    std::unique_ptr<leaf::file_writer> writer_;
+};
+
+bool async_file_native() { return false; }
+#endif
+//
+async_file_writer::async_file_writer(const boost::asio::any_io_executor& ex, std::string filename)
+    : impl_(new async_file_impl(ex, std::move(filename)))
+{
+}
+async_file_writer::~async_file_writer() { delete impl_; }
+boost::system::error_code async_file_writer::open() { return impl_->open(async_file_impl::file_operation::write); }
+boost::system::error_code async_file_writer::close() { return impl_->close(); }
+std::size_t async_file_writer::size() { return impl_->write_size(); }
+std::string async_file_writer::name() const { return impl_->name(); }
+boost::asio::awaitable<std::size_t> async_file_writer::write_at(std::int64_t offset,
+                                                                void const* buffer,
+                                                                std::size_t size,
+                                                                boost::system::error_code& ec)
+{
+    co_return co_await impl_->write_at(offset, buffer, size, ec);
+}
+//
+async_file_reader::async_file_reader(const boost::asio::any_io_executor& ex, std::string filename)
+    : impl_(new async_file_impl(ex, std::move(filename)))
+{
+}
+async_file_reader::~async_file_reader() { delete impl_; }
+boost::system::error_code async_file_reader::open() { return impl_->open(async_file_impl::file_operation::read); }
+boost::system::error_code async_file_reader::close() { return impl_->close(); }
+std::size_t async_file_reader::size() { return impl_->read_size(); }
+std::string async_file_reader::name() const { return impl_->name(); }
+boost::asio::awaitable<std::size_t> async_file_reader::read_at(std::int64_t offset,
+                                                               void* buffer,
+                                                               std::size_t size,
+                                                               boost::system::error_code& ec)
+{
+    co_return co_await impl_->read_at(offset, buffer, size, ec);
+}
+
+}    // namespace leaf
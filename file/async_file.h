@@ -0,0 +1,91 @@
+#ifndef LEAF_FILE_ASYNC_FILE_H
+#define LEAF_FILE_ASYNC_FILE_H
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace leaf
+{
+// 异步文件读写, 支持 io_uring (BOOST_ASIO_HAS_IO_URING) 或 IOCP 时在事件循环上完成,
+// 否则在磁盘线程池 (disk_executors) 上使用 file_reader / file_writer 同步读写
+class async_file_impl;
+
+class async_writer
+{
+   public:
+    virtual ~async_writer() = default;
+
+   public:
+    [[nodiscard]] virtual std::string name() const = 0;
+    virtual boost::system::error_code open() = 0;
+    virtual boost::system::error_code close() = 0;
+    virtual boost::asio::awaitable<std::size_t> write_at(std::int64_t offset,
+                                                         void const* buffer,
+                                                         std::size_t size,
+                                                         boost::system::error_code& ec) = 0;
+    virtual std::size_t size() = 0;
+};
+
+class async_reader
+{
+   public:
+    virtual ~async_reader() = default;
+
+   public:
+    [[nodiscard]] virtual std::string name() const = 0;
+    virtual boost::system::error_code open() = 0;
+    virtual boost::system::error_code close() = 0;
+    virtual boost::asio::awaitable<std::size_t> read_at(std::int64_t offset,
+                                                        void* buffer,
+                                                        std::size_t size,
+                                                        boost::system::error_code& ec) = 0;
+    virtual std::size_t size() = 0;
+};
+
+class async_file_writer : public async_writer
+{
+   public:
+    async_file_writer(const boost::asio::any_io_executor& ex, std::string filename);
+    ~async_file_writer() override;
+
+   public:
+    [[nodiscard]] std::string name() const override;
+    boost::system::error_code open() override;
+    boost::system::error_code close() override;
+    boost::asio::awaitable<std::size_t> write_at(std::int64_t offset,
+                                                 void const* buffer,
+                                                 std::size_t size,
+                                                 boost::system::error_code& ec) override;
+    std::size_t size() override;
+
+   private:
+    async_file_impl* impl_ = nullptr;
+};
+
+class async_file_reader : public async_reader
+{
+   public:
+    async_file_reader(const boost::asio::any_io_executor& ex, std::string filename);
+    ~async_file_reader() override;
+
+   public:
+    [[nodiscard]] std::string name() const override;
+    boost::system::error_code open() override;
+    boost::system::error_code close() override;
+    boost::asio::awaitable<std::size_t> read_at(std::int64_t offset,
+                                                void* buffer,
+                                                std::size_t size,
+                                                boost::system::error_code& ec) override;
+    std::size_t size() override;
+
+   private:
+    async_file_impl* impl_ = nullptr;
+};
+
+// 是否使用了真正的异步文件后端
+bool async_file_native();
+
+}    // namespace leaf
+
+#endif
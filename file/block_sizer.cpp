@@ -0,0 +1,61 @@
+#include <algorithm>
+#include "config/config.h"
+#include "file/block_sizer.h"
+
+namespace leaf
+{
+// 每次调整之间的写入次数
+constexpr uint32_t kSizerSamples = 16;
+// 指数平均的权重
+constexpr double kSizerAlpha = 0.125;
+
+block_sizer::block_sizer(uint32_t initial, uint32_t min_size, uint32_t max_size) { reset(initial, min_size, max_size); }
+
+void block_sizer::reset(uint32_t initial, uint32_t min_size, uint32_t max_size)
+{
+    min_size_ = min_size;
+    max_size_ = std::max(max_size, min_size);
+    size_ = std::clamp(initial, min_size_, max_size_);
+    samples_ = 0;
+    bandwidth_ = 0;
+}
+
+void block_sizer::on_write(std::size_t bytes, std::chrono::steady_clock::duration elapsed)
+{
+    // 控制消息太小, 不能反映带宽
+    if (bytes < kMinBlockSize || min_size_ == max_size_)
+    {
+        return;
+    }
+    auto seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+    auto bandwidth = static_cast<double>(bytes) / seconds;
+    bandwidth_ = bandwidth_ == 0 ? bandwidth : bandwidth_ + kSizerAlpha * (bandwidth - bandwidth_);
+    if (++samples_ >= kSizerSamples)
+    {
+        samples_ = 0;
+        adjust();
+    }
+}
+
+void block_sizer::on_rtt(std::chrono::steady_clock::duration rtt)
+{
+    auto seconds = std::chrono::duration<double>(rtt).count();
+    if (seconds <= 0)
+    {
+        return;
+    }
+    rtt_ = rtt_ == 0 ? seconds : rtt_ + kSizerAlpha * (seconds - rtt_);
+}
+
+void block_sizer::adjust()
+{
+    auto period = std::max(rtt_ / kDefaultWindow, std::chrono::duration<double>(kBlockTargetTime).count());
+    auto target = bandwidth_ * period;
+    // 每次最多翻倍或减半, 避免抖动
+    target = std::clamp(target, size_ / 2.0, size_ * 2.0);
+    target = std::clamp(target, static_cast<double>(min_size_), static_cast<double>(max_size_));
+    // 按最小块大小对齐
+    size_ = std::max(static_cast<uint32_t>(target) / kMinBlockSize * kMinBlockSize, min_size_);
+}
+
+}    // namespace leaf
@@ -0,0 +1,41 @@
+#ifndef LEAF_FILE_BLOCK_SIZER_H
+#define LEAF_FILE_BLOCK_SIZER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace leaf
+{
+// 发送端的数据块大小, 根据写入耗时估计带宽, 根据 keepalive 估计 rtt
+// 目标大小约为带宽乘以 max(rtt / window, kBlockTargetTime), 高带宽高延迟时变大, 慢速或丢包时变小
+// 只在连接的 io 线程上使用
+class block_sizer
+{
+   public:
+    block_sizer(uint32_t initial, uint32_t min_size, uint32_t max_size);
+
+   public:
+    [[nodiscard]] uint32_t size() const { return size_; }
+    // 协商之后设置范围, 对端不支持时 min 和 max 都是协商的块大小
+    void reset(uint32_t initial, uint32_t min_size, uint32_t max_size);
+    // 一个消息写入 socket 的字节数和耗时
+    void on_write(std::size_t bytes, std::chrono::steady_clock::duration elapsed);
+    // keepalive 测得的往返时间
+    void on_rtt(std::chrono::steady_clock::duration rtt);
+
+   private:
+    void adjust();
+
+   private:
+    uint32_t size_ = 0;
+    uint32_t min_size_ = 0;
+    uint32_t max_size_ = 0;
+    uint32_t samples_ = 0;
+    double bandwidth_ = 0;    // 字节每秒, 指数平均
+    double rtt_ = 0;          // 秒, 指数平均
+};
+
+}    // namespace leaf
+
+#endif
@@ -0,0 +1,117 @@
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include "crypt/blake2b.h"
+#include "config/config.h"
+#include "file/checkpoint.h"
+
+namespace leaf
+{
+struct checkpoint_window
+{
+    uint64_t end = 0;
+    std::string hash;
+};
+
+std::string encode_checkpoint_filename(const std::string& tmp_filename) { return tmp_filename + kCheckpointFilenameSuffix; }
+
+boost::system::error_code create_checkpoint(const std::string& tmp_filename, uint64_t file_size)
+{
+    std::ofstream out(encode_checkpoint_filename(tmp_filename), std::ios::trunc);
+    out << file_size << '\n';
+    out.flush();
+    if (!out)
+    {
+        return boost::system::errc::make_error_code(boost::system::errc::io_error);
+    }
+    return {};
+}
+
+boost::system::error_code append_checkpoint(const std::string& tmp_filename, uint64_t end, const std::string& hash)
+{
+    std::ofstream out(encode_checkpoint_filename(tmp_filename), std::ios::app);
+    out << end << ' ' << hash << '\n';
+    out.flush();
+    if (!out)
+    {
+        return boost::system::errc::make_error_code(boost::system::errc::io_error);
+    }
+    return {};
+}
+
+static std::string window_hash(std::ifstream& in, uint64_t size)
+{
+    leaf::blake2b hash;
+    std::vector<char> buffer(kBlockSize);
+    while (size > 0 && in)
+    {
+        auto n = static_cast<std::streamsize>(std::min<uint64_t>(size, buffer.size()));
+        in.read(buffer.data(), n);
+        hash.update(buffer.data(), static_cast<uint32_t>(in.gcount()));
+        size -= static_cast<uint64_t>(in.gcount());
+    }
+    if (size != 0)
+    {
+        return {};
+    }
+    hash.final();
+    return hash.hex();
+}
+
+uint64_t restore_checkpoint(const std::string& tmp_filename, uint64_t file_size, boost::system::error_code& ec)
+{
+    uint64_t recorded_size = 0;
+    std::vector<checkpoint_window> windows;
+    {
+        std::ifstream ckpt(encode_checkpoint_filename(tmp_filename));
+        if (ckpt >> recorded_size)
+        {
+            checkpoint_window w;
+            while (ckpt >> w.end >> w.hash)
+            {
+                windows.push_back(w);
+            }
+        }
+    }
+    if (recorded_size != file_size)
+    {
+        windows.clear();
+    }
+    // 断点只在 hash 窗口写完后追加, 数据可能没有落盘, 重新计算确认
+    uint64_t offset = 0;
+    std::vector<checkpoint_window> verified;
+    std::ifstream in(tmp_filename, std::ios::binary);
+    for (const auto& w : windows)
+    {
+        if (w.end <= offset || w.end > file_size || window_hash(in, w.end - offset) != w.hash)
+        {
+            break;
+        }
+        offset = w.end;
+        verified.push_back(w);
+    }
+    in.close();
+    std::filesystem::resize_file(tmp_filename, offset, ec);
+    if (ec)
+    {
+        return 0;
+    }
+    ec = create_checkpoint(tmp_filename, file_size);
+    for (const auto& w : verified)
+    {
+        if (ec)
+        {
+            return 0;
+        }
+        ec = append_checkpoint(tmp_filename, w.end, w.hash);
+    }
+    return ec ? 0 : offset;
+}
+
+void remove_checkpoint(const std::string& tmp_filename)
+{
+    boost::system::error_code ec;
+    std::filesystem::remove(encode_checkpoint_filename(tmp_filename), ec);
+}
+
+}    // namespace leaf
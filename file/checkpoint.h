@@ -0,0 +1,24 @@
+#ifndef LEAF_FILE_CHECKPOINT_H
+#define LEAF_FILE_CHECKPOINT_H
+
+#include <string>
+#include <cstdint>
+#include <boost/system/error_code.hpp>
+
+namespace leaf
+{
+// 上传断点, 与 .tmp 文件放在一起, 记录已经校验通过的 hash 窗口
+// 第一行是文件大小, 之后每行是一个窗口的结束位置和 hash
+std::string encode_checkpoint_filename(const std::string& tmp_filename);
+// 创建断点文件, 已有的记录会被清空
+boost::system::error_code create_checkpoint(const std::string& tmp_filename, uint64_t file_size);
+// 追加一个校验通过的窗口
+boost::system::error_code append_checkpoint(const std::string& tmp_filename, uint64_t end, const std::string& hash);
+// 重新计算 .tmp 中记录过的窗口, 返回最后一个匹配窗口的结束位置
+// 之后的数据和记录都被截断, 没有断点或文件大小不一致时返回 0
+uint64_t restore_checkpoint(const std::string& tmp_filename, uint64_t file_size, boost::system::error_code& ec);
+void remove_checkpoint(const std::string& tmp_filename);
+
+}    // namespace leaf
+
+#endif
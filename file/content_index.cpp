@@ -0,0 +1,120 @@
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "config/config.h"
+#include "file/file.h"
+#include "file/hash_file.h"
+#include "file/content_index.h"
+
+namespace leaf
+{
+// blake2b 的 hex, 同时防止 hash 被当作路径
+static bool valid_hash(const std::string& hash)
+{
+    constexpr std::size_t kHashHexSize = 128;
+    return hash.size() == kHashHexSize &&
+           std::all_of(hash.begin(), hash.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+std::string content_object_path(const std::string& token, const std::string& hash)
+{
+    return std::filesystem::path(leaf::kDefaultDir).append(kObjectsDir).append(token).append(hash.substr(0, 2)).append(hash).string();
+}
+
+bool link_content(
+    const std::string& token, const std::string& hash, uint64_t file_size, const std::string& leaf_file, boost::system::error_code& ec)
+{
+    if (token.empty() || !valid_hash(hash))
+    {
+        return false;
+    }
+    auto object = content_object_path(token, hash);
+    if (!std::filesystem::exists(object, ec) || ec)
+    {
+        return false;
+    }
+    if (std::filesystem::file_size(object, ec) != file_size || ec)
+    {
+        return false;
+    }
+    // 先链接到临时名字再改名, 覆盖已有的同名文件; 跨文件系统时链接失败, 由调用方退回完整上传
+    auto tmp_link = object + "." + std::to_string(leaf::file_id()) + kTmpFilenameSuffix;
+    std::filesystem::remove(tmp_link, ec);
+    std::filesystem::create_hard_link(object, tmp_link, ec);
+    if (ec)
+    {
+        return false;
+    }
+    std::filesystem::rename(tmp_link, leaf_file, ec);
+    // 目标已经是同一个 inode 时 rename 不做任何事, 临时链接需要删除
+    boost::system::error_code ignore;
+    std::filesystem::remove(tmp_link, ignore);
+    return !ec;
+}
+
+void index_content(const std::string& token, const std::string& file, const std::string& hash, boost::system::error_code& ec)
+{
+    if (token.empty() || !valid_hash(hash))
+    {
+        return;
+    }
+    auto object = content_object_path(token, hash);
+    if (std::filesystem::exists(object, ec) || ec)
+    {
+        return;
+    }
+    auto file_hash = leaf::hash_file(file, ec);
+    if (ec || file_hash != hash)
+    {
+        return;
+    }
+    std::filesystem::create_directories(std::filesystem::path(object).parent_path(), ec);
+    if (ec)
+    {
+        return;
+    }
+    // 先链接到临时名字再改名, 同时加入同一个内容时不会失败
+    auto tmp_object = object + kTmpFilenameSuffix;
+    std::filesystem::remove(tmp_object, ec);
+    std::filesystem::create_hard_link(file, tmp_object, ec);
+    if (ec)
+    {
+        return;
+    }
+    std::filesystem::rename(tmp_object, object, ec);
+}
+
+std::size_t reclaim_content(boost::system::error_code& ec)
+{
+    auto objects = std::filesystem::path(leaf::kDefaultDir).append(kObjectsDir);
+    std::size_t count = 0;
+    if (!std::filesystem::exists(objects, ec) || ec)
+    {
+        return count;
+    }
+    std::vector<std::filesystem::path> garbage;
+    for (std::filesystem::recursive_directory_iterator it(objects, ec), end; !ec && it != end; it.increment(ec))
+    {
+        boost::system::error_code entry_ec;
+        if (!it->is_regular_file(entry_ec) || entry_ec)
+        {
+            continue;
+        }
+        // 临时链接只在链接和改名之间存在, 与正在进行的链接同时发生时那次去重退回完整上传
+        if (it->path().extension() == kTmpFilenameSuffix || it->hard_link_count(entry_ec) == 1)
+        {
+            garbage.push_back(it->path());
+        }
+    }
+    for (const auto& p : garbage)
+    {
+        boost::system::error_code remove_ec;
+        if (std::filesystem::remove(p, remove_ec))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+}    // namespace leaf
@@ -0,0 +1,25 @@
+#ifndef LEAF_FILE_CONTENT_INDEX_H
+#define LEAF_FILE_CONTENT_INDEX_H
+
+#include <string>
+#include <cstdint>
+#include <boost/system/error_code.hpp>
+
+namespace leaf
+{
+// 内容寻址索引, kDefaultDir/kObjectsDir/<token>/<hash 前两位>/<hash> 是已存储文件的硬链接
+// 文件只通过 .tmp 改名替换, 不会原地修改, 共享 inode 是安全的
+// 索引按用户隔离, 客户端只提供 hash 和大小, 不能证明拥有内容, 跨用户共享会泄漏其他用户的文件
+std::string content_object_path(const std::string& token, const std::string& hash);
+// 用户索引中有 hash 相同且大小一致的内容时硬链接到最终的 .leaf 文件, 返回是否链接成功
+// 不经过 .tmp, 中断的上传续传时不会原地修改共享的 inode
+bool link_content(
+    const std::string& token, const std::string& hash, uint64_t file_size, const std::string& leaf_file, boost::system::error_code& ec);
+// 上传完成后加入用户的索引, hash 来自客户端, 重新计算校验一致后才加入
+void index_content(const std::string& token, const std::string& file, const std::string& hash, boost::system::error_code& ec);
+// 删除只剩索引一个链接的对象 (文件已被删除或覆盖) 和中断留下的临时链接, 返回删除的数量
+std::size_t reclaim_content(boost::system::error_code& ec);
+
+}    // namespace leaf
+
+#endif
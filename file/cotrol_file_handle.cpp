@@ -6,6 +6,8 @@
 #include "file/file.h"
 #include "config/config.h"
 #include "protocol/codec.h"
+#include "file/disk_executors.h"
+#include "file/memory_governor.h"
 #include "file/cotrol_file_handle.h"
 
 namespace leaf
@@ -32,13 +34,13 @@ boost::asio::awaitable<void> cotrol_file_handle ::write_coro()
     while (true)
     {
         boost::system::error_code ec;
-        auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
             LOG_ERROR("{} write_coro error {}", id_, ec.message());
             break;
         }
-        co_await session_->write(ec, bytes.data(), bytes.size());
+        co_await session_->write(ec, frame.buffers());
         if (ec)
         {
             LOG_ERROR("{} write_coro error {}", id_, ec.message());
@@ -144,7 +146,7 @@ boost::asio::awaitable<void> cotrol_file_handle::keepalive(boost::beast::error_c
               sk.server_timestamp,
               sk.client_timestamp,
               token_);
-    co_await channel_.async_send(ec, serialize_keepalive(sk), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(serialize_keepalive(sk, options_.codec)), ec);
 }
 boost::asio::awaitable<void> cotrol_file_handle::wait_login(boost::beast::error_code& ec)
 {
@@ -154,31 +156,24 @@ boost::asio::awaitable<void> cotrol_file_handle::wait_login(boost::beast::error_
         LOG_ERROR("{} handshake error {}", id_, ec.message());
         co_return;
     }
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
+    auto login = co_await leaf::read_login(*session_, leaf::local_hello(), options_, nullptr, ec);
     if (ec)
     {
         LOG_ERROR("{} login error {}", id_, ec.message());
         co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    auto bytes = std::vector<uint8_t>(message.begin(), message.end());
-    if (type != leaf::message_type::login)
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
-    auto login = leaf::deserialize_login_token(bytes);
-    if (!login.has_value())
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
 
-    token_ = login->token;
-    LOG_INFO("{} login success token {}", id_, token_);
-    co_await channel_.async_send(ec, leaf::serialize_login_token(login.value()), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    token_ = login->token.token;
+    // 同一个 token 的连接共享分组限速
+    session_->join_rate_group(token_);
+    LOG_INFO("{} login success token {} version {} capabilities {} block size {} window {}",
+             id_,
+             token_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::login_reply(login.value(), options_)), ec);
 }
 static std::vector<leaf::file_node> lookup_dir(const std::filesystem::path& dir)
 {
@@ -230,18 +225,24 @@ boost::asio::awaitable<void> cotrol_file_handle::on_files_request(const std::str
 
     const auto& msg = files_request.value();
     std::string user_path = leaf::make_file_path(msg.token);
-    auto dir_path = leaf::make_file_path(msg.token, msg.dir);
+    std::string dir_path;
     leaf::files_response response;
     // 递归遍历目录中的所有文件
-    auto files = lookup_dir(dir_path);
-    for (auto&& file : files)
-    {
-        file.name = std::filesystem::relative(file.name, user_path).string();
-    }
+    auto files = co_await leaf::dio::instance().run(user_path,
+                                                    [&]()
+                                                    {
+                                                        dir_path = leaf::make_file_path(msg.token, msg.dir);
+                                                        auto nodes = lookup_dir(dir_path);
+                                                        for (auto&& node : nodes)
+                                                        {
+                                                            node.name = std::filesystem::relative(node.name, user_path).string();
+                                                        }
+                                                        return nodes;
+                                                    });
     response.token = msg.token;
     response.files.swap(files);
     LOG_INFO("{} on files request dir {}", id_, dir_path);
-    co_await channel_.async_send(ec, leaf::serialize_files_response(response), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::serialize_files_response(response, options_.codec)), ec);
 }
 
 boost::asio::awaitable<void> cotrol_file_handle::on_create_dir(const std::string& message, boost::beast::error_code& ec)
@@ -254,7 +255,7 @@ boost::asio::awaitable<void> cotrol_file_handle::on_create_dir(const std::string
     }
 
     std::string user_path = leaf::make_file_path(dir_request->token);
-    auto dir_path = leaf::make_file_path(dir_request->token, dir_request->dir);
+    auto dir_path = co_await leaf::dio::instance().run(user_path, [&]() { return leaf::make_file_path(dir_request->token, dir_request->dir); });
     if (dir_path.empty())
     {
         LOG_ERROR("{} create dir {} failed", id_, dir_request->dir);
@@ -4,6 +4,9 @@
 #include <mutex>
 #include <boost/asio/experimental/channel.hpp>
 #include "protocol/message.h"
+#include "protocol/capability.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/websocket_handle.h"
 
 namespace leaf
@@ -34,10 +37,13 @@ class cotrol_file_handle : public websocket_handle
    private:
     std::string id_;
     std::string token_;
+    leaf::session_options options_;
     std::once_flag shutdown_flag_;
     leaf::websocket_session::ptr session_;
-    const boost::asio::any_io_executor& io_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    boost::asio::any_io_executor io_;
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 
 }    // namespace leaf
@@ -6,6 +6,7 @@
 #include "log/log.h"
 #include "protocol/codec.h"
 #include "protocol/message.h"
+#include "file/memory_governor.h"
 #include "file/cotrol_session.h"
 
 namespace leaf
@@ -21,7 +22,8 @@ cotrol_session::~cotrol_session() = default;
 void cotrol_session::startup()
 {
     LOG_INFO("{} startup", id_);
-    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/cotrol", io_);
+    auto profile = leaf::socket_presets::instance().control();
+    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/cotrol", io_, profile);
 
     boost::asio::co_spawn(io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await recv_coro(); }, boost::asio::detached);
 
@@ -44,8 +46,15 @@ boost::asio::awaitable<void> cotrol_session::recv_coro()
     leaf::login_token lt;
     lt.id = 0x01;
     lt.token = token_;
-    auto bytes = leaf::serialize_login_token(lt);
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    leaf::fill_hello(lt);
+    // 协商之前使用 json, 旧版本服务端也能解析
+    auto bytes = leaf::serialize_login_token(lt, leaf::codec_format::json);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+    if (ec)
+    {
+        co_return;
+    }
+    co_await wait_login(lt, ec);
     if (ec)
     {
         co_return;
@@ -99,8 +108,8 @@ boost::asio::awaitable<void> cotrol_session::timer_coro()
         leaf::files_request req;
         req.token = token_;
         req.dir = current_dir_;
-        auto bytes = leaf::serialize_files_request(req);
-        co_await channel_.async_send(ec, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto bytes = leaf::serialize_files_request(req, options_.codec);
+        co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
         if (ec)
         {
             LOG_ERROR("{} timer coro error {}", id_, ec.message());
@@ -115,13 +124,13 @@ boost::asio::awaitable<void> cotrol_session::write_coro()
     while (true)
     {
         boost::system::error_code ec;
-        auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
             LOG_ERROR("{} write coro error {}", id_, ec.message());
             co_return;
         }
-        co_await ws_client_->write(ec, bytes.data(), bytes.size());
+        co_await ws_client_->write(ec, frame.buffers());
         if (ec)
         {
             LOG_ERROR("{} write coro error {}", id_, ec.message());
@@ -153,9 +162,9 @@ boost::asio::awaitable<void> cotrol_session::create_directory_coro(const std::st
     leaf::create_dir cd;
     cd.dir = dir;
     cd.token = token_;
-    auto bytes = leaf::serialize_create_dir(cd);
+    auto bytes = leaf::serialize_create_dir(cd, options_.codec);
     boost::system::error_code ec;
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 void cotrol_session::create_directory(const std::string& dir)
 {
@@ -167,4 +176,20 @@ void cotrol_session::create_directory(const std::string& dir)
 
 void cotrol_session::change_current_dir(const std::string& dir) { current_dir_ = dir; }
 
+boost::asio::awaitable<void> cotrol_session::wait_login(const leaf::login_token& hello, boost::beast::error_code& ec)
+{
+    co_await leaf::read_login(*ws_client_, hello, options_, nullptr, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} wait login error {}", id_, ec.message());
+        co_return;
+    }
+    LOG_INFO("{} login success version {} capabilities {} block size {} window {}",
+             id_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
+}
+
 }    // namespace leaf
@@ -8,6 +8,9 @@
 #include <boost/asio/experimental/channel.hpp>
 #include "file/event.h"
 #include "protocol/codec.h"
+#include "protocol/capability.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/plain_websocket_client.h"
 
 namespace leaf
@@ -28,6 +31,7 @@ class cotrol_session : public std::enable_shared_from_this<cotrol_session>
     boost::asio::awaitable<void> recv_coro();
     boost::asio::awaitable<void> timer_coro();
     boost::asio::awaitable<void> write_coro();
+    boost::asio::awaitable<void> wait_login(const leaf::login_token &hello, boost::beast::error_code &ec);
     boost::asio::awaitable<void> create_directory_coro(const std::string &dir);
     boost::asio::awaitable<void> shutdown_coro();
 
@@ -36,11 +40,14 @@ class cotrol_session : public std::enable_shared_from_this<cotrol_session>
     std::string host_;
     std::string port_;
     std::string token_;
+    leaf::session_options options_;
     std::string current_dir_;
     leaf::cotrol_handle handler_;
     boost::asio::io_context &io_;
     std::shared_ptr<leaf::plain_websocket_client> ws_client_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 
 }    // namespace leaf
@@ -0,0 +1,37 @@
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include "file/credit_window.h"
+
+namespace leaf
+{
+credit_window::credit_window(const boost::asio::any_io_executor& ex, uint32_t credits) : credits_(credits), wakeup_(ex) {}
+
+boost::asio::awaitable<void> credit_window::acquire(boost::system::error_code& ec)
+{
+    while (credits_ == 0 && !closed_)
+    {
+        wakeup_.expires_at(boost::asio::steady_timer::time_point::max());
+        co_await wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    }
+    if (closed_)
+    {
+        ec = boost::asio::error::operation_aborted;
+        co_return;
+    }
+    ec = {};
+    credits_--;
+}
+
+void credit_window::grant(uint32_t count)
+{
+    credits_ += count;
+    wakeup_.cancel();
+}
+
+void credit_window::close()
+{
+    closed_ = true;
+    wakeup_.cancel();
+}
+
+}    // namespace leaf
@@ -0,0 +1,33 @@
+#ifndef LEAF_FILE_CREDIT_WINDOW_H
+#define LEAF_FILE_CREDIT_WINDOW_H
+
+#include <cstdint>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace leaf
+{
+// 发送端的信用窗口, 每发送一个数据消息消耗一个信用
+// 接收端写入完成后通过 credit 消息归还, 没有信用时发送挂起
+// 每个 stream 在途的数据不超过 window 个块, 只在连接的 io 线程上使用
+class credit_window
+{
+   public:
+    credit_window(const boost::asio::any_io_executor& ex, uint32_t credits);
+
+   public:
+    boost::asio::awaitable<void> acquire(boost::system::error_code& ec);
+    void grant(uint32_t count);
+    // 连接断开, 唤醒等待中的发送
+    void close();
+
+   private:
+    bool closed_ = false;
+    uint32_t credits_ = 0;
+    boost::asio::steady_timer wakeup_;
+};
+
+}    // namespace leaf
+
+#endif
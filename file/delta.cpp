@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <unordered_map>
+#include "file/delta.h"
+#include "crypt/blake2b.h"
+#include "config/config.h"
+
+namespace leaf
+{
+// 滚动校验和的两部分, a 是字节和, b 是 a 的前缀和, 都按 16 位截断
+static void checksum_parts(const uint8_t* data, std::size_t size, uint32_t& a, uint32_t& b)
+{
+    a = 0;
+    b = 0;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        a += data[i];
+        b += a;
+    }
+}
+
+static uint32_t combine(uint32_t a, uint32_t b) { return (a & 0xffff) | (b << 16); }
+
+static std::string strong_checksum(const uint8_t* data, std::size_t size)
+{
+    leaf::blake2b b;
+    b.update(data, static_cast<uint32_t>(size));
+    b.final();
+    return b.hex();
+}
+
+uint32_t delta_block_size(uint64_t file_size, uint32_t block_size)
+{
+    auto min_size = (file_size + kMaxDeltaBlocks - 1) / kMaxDeltaBlocks;
+    // 保持 block_size 的整数倍, 复制时按块写入
+    min_size = (min_size + block_size - 1) / block_size * block_size;
+    return static_cast<uint32_t>(std::max<uint64_t>(block_size, min_size));
+}
+
+uint32_t weak_checksum(const uint8_t* data, std::size_t size)
+{
+    uint32_t a = 0;
+    uint32_t b = 0;
+    checksum_parts(data, size, a, b);
+    return combine(a, b);
+}
+
+std::vector<leaf::delta_block> make_signature(const leaf::mmap_file_reader& file, uint32_t block_size)
+{
+    std::vector<leaf::delta_block> signature;
+    const uint64_t count = file.size() / block_size;
+    signature.reserve(count);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        auto block = file.slice(i * block_size, block_size);
+        const auto* data = static_cast<const uint8_t*>(block.data());
+        signature.push_back(leaf::delta_block{weak_checksum(data, block.size()), strong_checksum(data, block.size())});
+    }
+    return signature;
+}
+
+std::vector<leaf::delta_op> make_delta(const leaf::mmap_file_reader& file, uint32_t block_size, const std::vector<leaf::delta_block>& signature)
+{
+    std::vector<leaf::delta_op> ops;
+    const uint64_t size = file.size();
+    const auto* data = static_cast<const uint8_t*>(file.slice(0, size).data());
+    std::unordered_map<uint32_t, std::vector<uint64_t>> table;
+    for (uint64_t i = 0; i < signature.size(); i++)
+    {
+        table[signature[i].weak].push_back(i);
+    }
+    auto add_literal = [&ops](uint64_t begin, uint64_t end)
+    {
+        if (end > begin)
+        {
+            ops.push_back(leaf::delta_op{false, begin, end - begin, 0, 0});
+        }
+    };
+    auto add_copy = [&ops](uint64_t index)
+    {
+        if (!ops.empty() && ops.back().copy && ops.back().index + ops.back().count == index)
+        {
+            ops.back().count++;
+            return;
+        }
+        ops.push_back(leaf::delta_op{true, 0, 0, index, 1});
+    };
+
+    uint64_t literal = 0;
+    uint64_t pos = 0;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    bool fresh = true;
+    while (!table.empty() && pos + block_size <= size)
+    {
+        if (fresh)
+        {
+            checksum_parts(data + pos, block_size, a, b);
+            fresh = false;
+        }
+        auto it = table.find(combine(a, b));
+        if (it != table.end())
+        {
+            auto strong = strong_checksum(data + pos, block_size);
+            const auto& candidates = it->second;
+            // 优先接上一个引用, 连续的块合并成一次复制
+            uint64_t next = !ops.empty() && ops.back().copy ? ops.back().index + ops.back().count : signature.size();
+            auto match = std::find(candidates.begin(), candidates.end(), next);
+            if (match == candidates.end() || signature[*match].strong != strong)
+            {
+                match = std::find_if(candidates.begin(), candidates.end(), [&](uint64_t index) { return signature[index].strong == strong; });
+            }
+            if (match != candidates.end())
+            {
+                add_literal(literal, pos);
+                add_copy(*match);
+                pos += block_size;
+                literal = pos;
+                fresh = true;
+                continue;
+            }
+        }
+        // 窗口后移一个字节
+        if (pos + block_size < size)
+        {
+            uint32_t out = data[pos];
+            uint32_t in = data[pos + block_size];
+            a = a - out + in;
+            b = b - block_size * out + a;
+        }
+        pos++;
+    }
+    add_literal(literal, size);
+    return ops;
+}
+
+}    // namespace leaf
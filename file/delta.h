@@ -0,0 +1,32 @@
+#ifndef LEAF_FILE_DELTA_H
+#define LEAF_FILE_DELTA_H
+
+#include <vector>
+#include <cstdint>
+#include "protocol/message.h"
+#include "file/mmap_file.h"
+
+namespace leaf
+{
+// rsync 方式的增量上传
+// 服务端把已有文件按固定大小分块, 每块计算滚动校验和与 blake2b 作为签名
+// 客户端在本地文件上滑动窗口查找相同的块, 只发送块引用和不匹配的数据
+struct delta_op
+{
+    bool copy = false;
+    uint64_t offset = 0;    // 字面数据在本地文件的位置
+    uint64_t length = 0;    // 字面数据的长度
+    uint64_t index = 0;     // 引用的第一个块
+    uint32_t count = 0;     // 连续引用的块数
+};
+
+// 签名块数有上限, 大文件使用更大的块
+uint32_t delta_block_size(uint64_t file_size, uint32_t block_size);
+uint32_t weak_checksum(const uint8_t* data, std::size_t size);
+// 只包含完整的块, 文件结尾不足一块的数据不参与匹配
+std::vector<leaf::delta_block> make_signature(const leaf::mmap_file_reader& file, uint32_t block_size);
+std::vector<leaf::delta_op> make_delta(const leaf::mmap_file_reader& file, uint32_t block_size, const std::vector<leaf::delta_block>& signature);
+
+}    // namespace leaf
+
+#endif
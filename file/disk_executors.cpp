@@ -0,0 +1,101 @@
+#include <filesystem>
+#include <functional>
+#include <sys/stat.h>
+#include "file/disk_executors.h"
+
+namespace leaf
+{
+static constexpr std::size_t kMaxDeviceCache = 4096;
+
+disk_executors::disk_executors() : disk_executors(kDiskLookupThreadSize, kDiskQueueDepth) {}
+
+disk_executors::disk_executors(std::size_t lookup_thread_size, std::size_t queue_depth)
+    : queue_depth_(queue_depth), lookup_(lookup_thread_size)
+{
+}
+
+disk_executors::~disk_executors() { shutdown(); }
+
+void disk_executors::shutdown()
+{
+    std::map<uint64_t, std::shared_ptr<device_pool>> queues;
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        stopped_ = true;
+        queues.swap(queues_);
+    }
+    lookup_.join();
+    for (auto&& [id, pool] : queues)
+    {
+        pool->join();
+    }
+}
+
+uint64_t disk_executors::device_id(const std::string& path)
+{
+    auto dir = std::filesystem::path(path).parent_path();
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        auto it = devices_.find(dir.string());
+        if (it != devices_.end())
+        {
+            return it->second;
+        }
+    }
+    // 文件可能还不存在, 向上找到第一个存在的目录
+    uint64_t id = 0;
+    boost::system::error_code ec;
+    auto p = dir;
+    while (!p.empty() && !std::filesystem::exists(p, ec))
+    {
+        p = p.parent_path();
+    }
+#ifdef _WIN32
+    id = std::hash<std::string>{}(p.root_name().string());
+#else
+    struct stat st = {};
+    if (!p.empty() && ::stat(p.string().c_str(), &st) == 0)
+    {
+        id = static_cast<uint64_t>(st.st_dev);
+    }
+#endif
+    std::lock_guard<std::mutex> const lock(mutex_);
+    if (devices_.size() > kMaxDeviceCache)
+    {
+        devices_.clear();
+    }
+    devices_[dir.string()] = id;
+    return id;
+}
+
+std::shared_ptr<disk_executors::device_pool> disk_executors::cached_device_queue(const std::string& path)
+{
+    auto dir = std::filesystem::path(path).parent_path().string();
+    std::lock_guard<std::mutex> const lock(mutex_);
+    auto device = devices_.find(dir);
+    if (device == devices_.end())
+    {
+        return nullptr;
+    }
+    auto it = queues_.find(device->second);
+    return it != queues_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<disk_executors::device_pool> disk_executors::device_queue(uint64_t id)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    auto it = queues_.find(id);
+    if (it != queues_.end())
+    {
+        return it->second;
+    }
+    auto pool = std::make_shared<device_pool>(queue_depth_);
+    // 停止后不再保存, 调用者持有的线程池在最后一个引用释放时结束
+    if (!stopped_)
+    {
+        queues_[id] = pool;
+    }
+    return pool;
+}
+
+}    // namespace leaf
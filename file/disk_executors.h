@@ -0,0 +1,83 @@
+#ifndef LEAF_FILE_DISK_EXECUTORS_H
+#define LEAF_FILE_DISK_EXECUTORS_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <boost/asio.hpp>
+#include "util/singleton.h"
+#include "config/config.h"
+
+namespace leaf
+{
+// 磁盘操作线程池, 与网络 executors 分离
+// 每个设备独占 queue_depth 个线程, 慢盘或挂起的设备只会阻塞自己的线程
+// 查询设备使用单独的线程池, 挂起的挂载点不会占用任何设备的读写线程
+class disk_executors
+{
+    using device_pool = boost::asio::thread_pool;
+
+   public:
+    disk_executors();
+    disk_executors(std::size_t lookup_thread_size, std::size_t queue_depth);
+    ~disk_executors();
+
+   public:
+    void shutdown();
+
+    // 在 path 所在设备的线程上执行 f, 完成后回到调用者所在的 executor
+    template <typename F>
+    boost::asio::awaitable<std::invoke_result_t<F>> run(const std::string& path, F f)
+    {
+        using result_type = std::invoke_result_t<F>;
+        auto pool = cached_device_queue(path);
+        if (pool == nullptr)
+        {
+            // 第一次访问的目录在查询线程池上查询所在设备, 不阻塞调用者的网络线程
+            auto id = co_await boost::asio::co_spawn(
+                lookup_, [this, &path]() -> boost::asio::awaitable<uint64_t> { co_return device_id(path); }, boost::asio::use_awaitable);
+            pool = device_queue(id);
+        }
+        // 设备的线程都在忙时排在该设备的队列中
+        if constexpr (std::is_void_v<result_type>)
+        {
+            co_await boost::asio::co_spawn(
+                *pool,
+                [&f]() -> boost::asio::awaitable<void>
+                {
+                    f();
+                    co_return;
+                },
+                boost::asio::use_awaitable);
+        }
+        else
+        {
+            co_return co_await boost::asio::co_spawn(
+                *pool, [&f]() -> boost::asio::awaitable<result_type> { co_return f(); }, boost::asio::use_awaitable);
+        }
+    }
+
+   private:
+    // 只查缓存, 不访问磁盘, 目录没有缓存时返回 nullptr
+    std::shared_ptr<device_pool> cached_device_queue(const std::string& path);
+    std::shared_ptr<device_pool> device_queue(uint64_t id);
+    // 访问文件系统, 只在查询线程池上调用
+    uint64_t device_id(const std::string& path);
+
+   private:
+    std::size_t queue_depth_ = 0;
+    std::mutex mutex_;
+    bool stopped_ = false;
+    boost::asio::thread_pool lookup_;
+    std::unordered_map<std::string, uint64_t> devices_;
+    std::map<uint64_t, std::shared_ptr<device_pool>> queues_;
+};
+
+using dio = singleton<disk_executors>;
+
+}    // namespace leaf
+
+#endif
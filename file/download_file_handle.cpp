@@ -4,9 +4,13 @@
 
 #include "log/log.h"
 #include "file/file.h"
+#include "file/mmap_file.h"
+#include "file/hash_file.h"
+#include "file/disk_executors.h"
 #include "crypt/easy.h"
 #include "config/config.h"
 #include "protocol/codec.h"
+#include "file/memory_governor.h"
 #include "file/download_file_handle.h"
 
 namespace leaf
@@ -34,13 +38,16 @@ boost::asio::awaitable<void> download_file_handle ::write_coro()
     while (true)
     {
         boost::system::error_code ec;
-        auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
             LOG_ERROR("{} write_coro error {}", id_, ec.message());
             break;
         }
-        co_await session_->write(ec, bytes.data(), bytes.size());
+        // 写入耗时用于估计带宽, 调整之后的数据块大小
+        auto start = std::chrono::steady_clock::now();
+        co_await session_->write(ec, frame.buffers());
+        sizer_.on_write(frame.size(), std::chrono::steady_clock::now() - start);
         if (ec)
         {
             LOG_ERROR("{} write_coro error {}", id_, ec.message());
@@ -80,45 +87,42 @@ boost::asio::awaitable<void> download_file_handle::recv_coro()
     boost::beast::flat_buffer buffer;
     while (true)
     {
-        co_await on_keepalive(ec);
+        buffer.consume(buffer.size());
+        co_await session_->read(ec, buffer);
         if (ec)
         {
-            LOG_ERROR("{} keepalive error {}", id_, ec.message());
+            LOG_ERROR("{} recv coro error {}", id_, ec.message());
             break;
         }
-        continue;
-
-        // setup 2 wait download file request
-        auto ctx = co_await wait_download_file_request(ec);
-        if (ec)
+        auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
+        auto type = leaf::get_message_type(message);
+        auto stream = leaf::get_message_stream(message);
+        if (type == leaf::message_type::keepalive)
         {
-            LOG_ERROR("{} download file request error {}", id_, ec.message());
-            co_return;
+            co_await on_keepalive(message, ec);
         }
-
-        // setup 3 send ack
-        co_await send_ack(ec);
-        if (ec)
+        else if (type == leaf::message_type::download_file_request)
         {
-            LOG_ERROR("{} ack error {}", id_, ec.message());
-            co_return;
+            co_await on_download_file_request(stream, message, ec);
         }
-
-        // setup 4 send file data
-        co_await send_file_data(ctx, ec);
-        if (ec)
+        else if (type == leaf::message_type::credit)
         {
-            LOG_ERROR("{} file data error {}", id_, ec.message());
-            co_return;
+            on_credit(message);
+        }
+        else
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         }
-        // setup 5 send data done
-        co_await send_file_done(ec);
         if (ec)
         {
-            LOG_ERROR("{} file done error {}", id_, ec.message());
-            co_return;
+            LOG_ERROR("{} recv coro message {} stream {} error {}", id_, static_cast<int>(type), stream, ec.message());
+            break;
         }
-        LOG_INFO("{} download file {} complete", id_, ctx.file->file_path);
+    }
+    // 连接断开, 唤醒等待信用的 stream
+    for (auto& [stream, credits] : credits_)
+    {
+        credits->close();
     }
 }
 
@@ -129,47 +133,27 @@ boost::asio::awaitable<void> download_file_handle::wait_login(boost::beast::erro
     {
         co_return;
     }
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
+    auto login = co_await leaf::read_login(*session_, leaf::local_hello(), options_, &sizer_, ec);
     if (ec)
     {
-        LOG_ERROR("{} recv_coro error {}", id_, ec.message());
-        co_return;
-    }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    auto bytes = std::vector<uint8_t>(message.begin(), message.end());
-    if (type != leaf::message_type::login)
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
-    auto login = leaf::deserialize_login_token(bytes);
-    if (!login.has_value())
-    {
+        LOG_ERROR("{} login error {}", id_, ec.message());
         co_return;
     }
 
-    token_ = login->token;
-
-    co_await channel_.async_send(ec, leaf::serialize_login_token(login.value()), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    token_ = login->token.token;
+    // 同一个 token 的连接共享分组限速
+    session_->join_rate_group(token_);
+    LOG_INFO("{} login success token {} version {} capabilities {} block size {} window {}",
+             id_,
+             token_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::login_reply(login.value(), options_)), ec);
 }
-boost::asio::awaitable<void> download_file_handle::on_keepalive(boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_file_handle::on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec)
 {
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
-    if (ec)
-    {
-        LOG_ERROR("{} recv_coro error {}", id_, ec.message());
-        co_return;
-    }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    if (type != leaf::message_type::keepalive)
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
     auto k = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
     if (!k.has_value())
     {
@@ -186,135 +170,265 @@ boost::asio::awaitable<void> download_file_handle::on_keepalive(boost::beast::er
               sk.server_timestamp,
               sk.client_timestamp,
               token_);
-    co_await channel_.async_send(ec, serialize_keepalive(sk), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(serialize_keepalive(sk, options_.codec)), ec);
 }
-boost::asio::awaitable<void> download_file_handle::error_message(uint32_t id, int32_t error_code)
+boost::asio::awaitable<void> download_file_handle::error_message(uint32_t stream, uint32_t id, int32_t error_code)
 {
     boost::system::error_code ec;
     leaf::error_message e;
     e.id = id;
     e.error = error_code;
-    auto bytes = leaf::serialize_error_message(e);
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    auto bytes = leaf::serialize_error_message(e, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
 boost::asio::awaitable<void> download_file_handle::send_file_data(leaf::download_file_handle::download_context& ctx, boost::beast::error_code& ec)
 {
-    uint8_t buffer[kBlockSize] = {0};
     auto hash = std::make_shared<leaf::blake2b>();
-    auto reader = std::make_shared<leaf::file_reader>(ctx.file->file_path);
-    ec = reader->open();
+    // 文件映射由发送中的 frame 持有, 最后一个数据块写完后释放
+    auto reader = std::make_shared<leaf::mmap_file_reader>(ctx.file->file_path);
+    ec = co_await leaf::dio::instance().run(ctx.file->file_path, [&]() { return reader->open(); });
     if (ec)
     {
         LOG_ERROR("{} download file open file {} error {}", id_, ctx.file->file_path, ec.message());
         co_return;
     }
-    while (true)
+    // 只发送请求的范围, 每个范围的 hash 窗口从范围起点开始
+    uint64_t offset = ctx.request.offset;
+    uint64_t file_size = std::min<uint64_t>(ctx.file->file_size, reader->size());
+    if (ctx.request.length != 0)
     {
-        auto read_size = reader->read_at(static_cast<int64_t>(reader->size()), buffer, kBlockSize, ec);
-        if (ec && ec != boost::asio::error::eof)
-        {
-            LOG_ERROR("{} download file read file {} error {}", id_, ctx.file->file_path, ec.message());
-            break;
-        }
-        leaf::file_data fd;
-        fd.data.insert(fd.data.end(), buffer, buffer + read_size);
-        if (read_size != 0)
-        {
-            hash->update(fd.data.data(), read_size);
-            ctx.file->hash_count++;
-        }
-        // block count hash or eof hash
-        if (ctx.file->hash_count == kHashBlockCount || ctx.file->file_size == reader->size() || ec == boost::asio::error::eof)
+        file_size = std::min<uint64_t>(file_size, offset + ctx.request.length);
+    }
+    // 数据块大小会变化, hash 窗口按字节计算
+    const uint64_t window_size = static_cast<uint64_t>(options_.block_size) * options_.hash_block_count;
+    uint64_t window_bytes = 0;
+    while (offset < file_size)
+    {
+        auto block = reader->slice(offset, std::min<uint64_t>(sizer_.size(), file_size - offset));
+        offset += block.size();
+        window_bytes += block.size();
+        ctx.file->hash_count++;
+        // 在磁盘线程上计算 hash, 缺页读盘不会阻塞网络线程, 随后的发送直接命中页缓存
+        co_await leaf::dio::instance().run(ctx.file->file_path, [&]() { hash->update(block.data(), block.size()); });
+        std::string block_hash;
+        // window hash or eof hash
+        if (window_bytes >= window_size || offset == file_size)
         {
             hash->final();
-            fd.hash = hash->hex();
+            block_hash = hash->hex();
             ctx.file->hash_count = 0;
+            window_bytes = 0;
             hash = std::make_shared<leaf::blake2b>();
         }
-        LOG_DEBUG("{} download file {} size {} hash {}", id_, ctx.file->file_path, read_size, fd.hash.empty() ? "empty" : fd.hash);
-        if (!fd.data.empty())
+        LOG_DEBUG("{} download file {} size {} hash {}", id_, ctx.file->file_path, block.size(), block_hash.empty() ? "empty" : block_hash);
+        auto frame = leaf::serialize_file_data(block_hash, block, reader);
+        leaf::set_message_stream(frame.header, ctx.stream);
+        co_await acquire_credit(ctx.stream, ec);
+        if (!ec)
         {
-            auto bytes = leaf::serialize_file_data(fd);
-            co_await channel_.async_send(ec, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            co_await leaf::governed_send(channel_, budget_, std::move(frame), ec);
         }
-        if (ec == boost::asio::error::eof || reader->size() == ctx.file->file_size)
+        if (ec)
         {
-            LOG_INFO("{} upload file {} complete", id_, ctx.file->file_path);
-            break;
+            LOG_ERROR("{} download file send file {} error {}", id_, ctx.file->file_path, ec.message());
+            co_return;
         }
     }
-    ec = reader->close();
-    if (ec)
-    {
-        LOG_ERROR("{} download file close file {} error {}", id_, ctx.file->file_path, ec.message());
-    }
+    LOG_INFO("{} download file {} complete", id_, ctx.file->file_path);
 }
 
-boost::asio::awaitable<void> download_file_handle::send_file_done(boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_file_handle::send_ack(uint32_t stream, boost::beast::error_code& ec)
 {
-    leaf::done d;
-    co_await channel_.async_send(ec, leaf::serialize_done(d), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    auto bytes = leaf::serialize_ack(leaf::ack{});
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
-boost::asio::awaitable<leaf::download_file_handle::download_context> download_file_handle::wait_download_file_request(boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_file_handle::send_file_done(uint32_t stream, boost::beast::error_code& ec)
 {
-    leaf::download_file_handle::download_context ctx;
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
+    auto bytes = leaf::serialize_done(leaf::done{});
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+}
+
+boost::asio::awaitable<void> download_file_handle::download_file(leaf::download_file_handle::download_context ctx, boost::beast::error_code& ec)
+{
+    co_await send_file_data(ctx, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} file data stream {} error {}", id_, ctx.stream, ec.message());
+        co_return;
+    }
+    co_await send_file_done(ctx.stream, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} file done stream {} error {}", id_, ctx.stream, ec.message());
+        co_return;
+    }
+    LOG_INFO("{} download file {} stream {} complete", id_, ctx.file->file_path, ctx.stream);
+}
+
+boost::asio::awaitable<uint64_t> download_file_handle::verify_prefix(const std::string& file,
+                                                                    uint64_t file_size,
+                                                                    const std::vector<std::string>& hashes,
+                                                                    boost::beast::error_code& ec)
+{
+    // 至少留一个窗口发送, 客户端据此确认文件完整
+    const uint64_t window = static_cast<uint64_t>(options_.block_size) * options_.hash_block_count;
+    const uint64_t count = file_size == 0 ? 0 : std::min<uint64_t>(hashes.size(), (file_size - 1) / window);
+    auto local = co_await leaf::dio::instance().run(file, [&]() { return leaf::hash_file_windows(file, window, count, ec); });
     if (ec)
     {
-        LOG_ERROR("{} recv coro error {}", id_, ec.message());
-        co_return ctx;
+        co_return 0;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    if (type != leaf::message_type::download_file_request)
+    uint64_t matched = 0;
+    while (matched < local.size() && local[matched] == hashes[matched])
     {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return ctx;
+        matched++;
     }
+    LOG_INFO("{} download file {} verified {} of {} windows", id_, file, matched, hashes.size());
+    co_return matched * window;
+}
+
+boost::asio::awaitable<void> download_file_handle::on_download_file_request(uint32_t stream,
+                                                                           std::span<const uint8_t> message,
+                                                                           boost::beast::error_code& ec)
+{
     auto download = leaf::deserialize_download_file_request(std::vector<uint8_t>(message.begin(), message.end()));
     if (!download.has_value())
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return ctx;
+        co_return;
     }
     const auto& msg = download.value();
-    auto download_file_path = leaf::encode_leaf_filename(leaf::make_file_path(token_, leaf::encode(msg.filename)));
-    LOG_INFO("{} download file {} to {}", id_, msg.filename, download_file_path);
-    bool exist = std::filesystem::exists(download_file_path, ec);
+    auto download_file_path = co_await leaf::dio::instance().run(
+        leaf::make_file_path(token_),
+        [this, &msg]() { return leaf::encode_leaf_filename(leaf::make_file_path(token_, leaf::encode(msg.filename))); });
+    LOG_INFO("{} download file {} stream {} to {}", id_, msg.filename, stream, download_file_path);
+    // 单个文件的错误通过 error_message 通知客户端, 不影响连接上的其他文件
+    boost::beast::error_code file_ec;
+    bool exist = co_await leaf::dio::instance().run(download_file_path, [&]() { return std::filesystem::exists(download_file_path, file_ec); });
+    if (!file_ec && !exist)
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::no_such_file_or_directory);
+    }
+    uint64_t file_size = 0;
+    if (!file_ec)
+    {
+        file_size = co_await leaf::dio::instance().run(download_file_path, [&]() { return std::filesystem::file_size(download_file_path, file_ec); });
+    }
+    // 客户端带了本地文件的窗口 hash, 从第一个不一致的窗口开始发送
+    uint64_t offset = msg.offset;
+    if (!file_ec && !msg.hashes.empty())
+    {
+        if (!options_.has(leaf::kCapResumeDownload) || msg.offset != 0)
+        {
+            file_ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+        }
+        else
+        {
+            offset = co_await verify_prefix(download_file_path, file_size, msg.hashes, file_ec);
+        }
+    }
+    // 范围下载, length 为 0 或超出文件大小时截断到文件结尾
+    uint64_t length = 0;
+    if (!file_ec && (offset != 0 || msg.length != 0))
+    {
+        if (!options_.has(leaf::kCapRangedDownload) || (offset != 0 && offset >= file_size))
+        {
+            file_ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+        }
+        else
+        {
+            length = msg.length == 0 ? file_size - offset : std::min<uint64_t>(msg.length, file_size - offset);
+        }
+    }
+    if (file_ec)
+    {
+        LOG_ERROR("{} download file {} stream {} error {}", id_, msg.filename, stream, file_ec.message());
+        co_await error_message(stream, msg.id, file_ec.value());
+        co_return;
+    }
+    leaf::download_file_handle::download_context ctx;
+    ctx.stream = stream;
+    ctx.file = std::make_shared<leaf::file_info>();
+    ctx.file->file_path = download_file_path;
+    ctx.file->file_size = file_size;
+    ctx.file->filename = msg.filename;
+    ctx.request = msg;
+    ctx.request.offset = offset;
+    ctx.request.length = length;
+    ctx.request.hashes.clear();
+    LOG_INFO("{} download_file file {} size {} range {} {}", id_, ctx.file->file_path, ctx.file->file_size, offset, length);
+    leaf::download_file_response response;
+    response.filename = ctx.file->filename;
+    response.id = msg.id;
+    response.filesize = ctx.file->file_size;
+    response.offset = offset;
+    response.length = length;
+    auto bytes = leaf::serialize_download_file_response(response, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
     if (ec)
     {
-        LOG_ERROR("{} download file {} exist error {}", id_, msg.filename, ec.message());
-        co_return ctx;
+        co_return;
     }
-    if (!exist)
+    if (options_.has(leaf::kCapMultiplex))
     {
-        LOG_ERROR("{} download file {} not exist", id_, download_file_path);
-        ec = boost::system::errc::make_error_code(boost::system::errc::no_such_file_or_directory);
-        co_return ctx;
+        // 每个 stream 独立发送, 数据帧在写通道上交错
+        if (options_.has(leaf::kCapCreditFlow))
+        {
+            credits_[stream] = std::make_shared<leaf::credit_window>(io_, options_.window);
+        }
+        boost::asio::co_spawn(
+            io_,
+            [this, self = shared_from_this(), ctx]() -> boost::asio::awaitable<void>
+            {
+                boost::beast::error_code ec;
+                co_await download_file(ctx, ec);
+                credits_.erase(ctx.stream);
+            },
+            boost::asio::detached);
+        co_return;
     }
-
-    auto file_size = std::filesystem::file_size(download_file_path, ec);
+    // 旧版本客户端逐个文件等待 ack, 数据和 done
+    co_await send_ack(stream, ec);
     if (ec)
     {
-        LOG_ERROR("{} download file {} size error {}", id_, msg.filename, ec.message());
-        co_return ctx;
+        LOG_ERROR("{} ack error {}", id_, ec.message());
+        co_return;
+    }
+    co_await download_file(ctx, ec);
+}
+
+boost::asio::awaitable<void> download_file_handle::acquire_credit(uint32_t stream, boost::beast::error_code& ec)
+{
+    auto it = credits_.find(stream);
+    if (it == credits_.end())
+    {
+        co_return;
+    }
+    // 等待期间连接可能断开, 持有窗口
+    auto credits = it->second;
+    co_await credits->acquire(ec);
+}
+
+void download_file_handle::on_credit(std::span<const uint8_t> message)
+{
+    auto c = leaf::deserialize_credit(message);
+    if (!c.has_value())
+    {
+        LOG_ERROR("{} credit message invalid", id_);
+        return;
+    }
+    // 已经结束的 stream 忽略
+    auto it = credits_.find(leaf::get_message_stream(message));
+    if (it != credits_.end())
+    {
+        it->second->grant(c->count);
     }
-    auto file = std::make_shared<leaf::file_info>();
-    file->file_path = download_file_path;
-    file->file_size = file_size;
-    file->filename = msg.filename;
-    ctx.file = file;
-    ctx.request = download.value();
-    LOG_INFO("{} download_file file {} size {}", id_, file->file_path, file->file_size);
-    leaf::download_file_response response;
-    response.filename = file->filename;
-    response.id = download->id;
-    response.filesize = file->file_size;
-    co_await channel_.async_send(ec, leaf::serialize_download_file_response(response), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-    co_return ctx;
 }
 
 }    // namespace leaf
@@ -1,13 +1,20 @@
 #ifndef LEAF_FILE_DOWNLOAD_FILE_HANDLE_H
 #define LEAF_FILE_DOWNLOAD_FILE_HANDLE_H
 
+#include <map>
+#include <span>
 #include <queue>
 #include <mutex>
 #include <boost/asio/experimental/channel.hpp>
 #include "file/file.h"
 #include "protocol/message.h"
+#include "protocol/capability.h"
 #include "crypt/blake2b.h"
 #include "file/file_context.h"
+#include "file/block_sizer.h"
+#include "file/credit_window.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/websocket_handle.h"
 
 namespace leaf
@@ -17,6 +24,7 @@ class download_file_handle : public websocket_handle
 {
     struct download_context
     {
+        uint32_t stream = 0;
         leaf::file_info::ptr file;
         leaf::download_file_request request;
     };
@@ -35,21 +43,35 @@ class download_file_handle : public websocket_handle
     boost::asio::awaitable<void> write_coro();
     boost::asio::awaitable<void> shutdown_coro();
     boost::asio::awaitable<void> wait_login(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> on_keepalive(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> error_message(uint32_t id, int32_t error_code);
-    boost::asio::awaitable<leaf::download_file_handle::download_context> wait_download_file_request(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> send_ack(boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> error_message(uint32_t stream, uint32_t id, int32_t error_code);
+    boost::asio::awaitable<void> on_download_file_request(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    // 比较客户端本地文件的窗口 hash, 返回可以续传的位置
+    boost::asio::awaitable<uint64_t> verify_prefix(const std::string& file,
+                                                   uint64_t file_size,
+                                                   const std::vector<std::string>& hashes,
+                                                   boost::beast::error_code& ec);
+    boost::asio::awaitable<void> download_file(leaf::download_file_handle::download_context ctx, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> send_ack(uint32_t stream, boost::beast::error_code& ec);
     boost::asio::awaitable<void> send_file_data(leaf::download_file_handle::download_context& ctx, boost::beast::error_code& ec);
-    boost::asio::awaitable<void> send_file_done(boost::beast::error_code& ec);
+    boost::asio::awaitable<void> send_file_done(uint32_t stream, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> acquire_credit(uint32_t stream, boost::beast::error_code& ec);
+    void on_credit(std::span<const uint8_t> message);
 
    private:
     std::string id_;
     std::string token_;
+    leaf::session_options options_;
+    leaf::block_sizer sizer_{kBlockSize, kBlockSize, kBlockSize};
     std::once_flag shutdown_flag_;
     leaf::websocket_session::ptr session_;
-    const boost::asio::any_io_executor& io_;
+    boost::asio::any_io_executor io_;
     std::queue<leaf::file_info::ptr> padding_files_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    // 协商了 kCapCreditFlow 时每个 stream 的发送信用
+    std::map<uint32_t, std::shared_ptr<leaf::credit_window>> credits_;
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 
 }    // namespace leaf
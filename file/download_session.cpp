@@ -3,8 +3,12 @@
 #include <filesystem>
 #include "log/log.h"
 #include "file/file.h"
+#include "file/async_file.h"
+#include "file/hash_file.h"
+#include "file/disk_executors.h"
 #include "config/config.h"
 #include "protocol/codec.h"
+#include "file/memory_governor.h"
 #include "file/download_session.h"
 
 namespace leaf
@@ -22,21 +26,47 @@ void download_session::startup()
 {
     LOG_INFO("{} startup", id_);
 
-    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/download", io_);
+    auto profile = leaf::socket_presets::instance().bulk();
+    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/download", io_, profile);
 
     boost::asio::co_spawn(
         io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await download_coro(); }, boost::asio::detached);
     boost::asio::co_spawn(io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await write_coro(); }, boost::asio::detached);
 }
 
-boost::asio::awaitable<void> download_session::keepalive(boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_session::send_keepalive(boost::beast::error_code& ec)
 {
     leaf::keepalive k;
     k.id = 0;
     k.client_id = reinterpret_cast<uintptr_t>(this);
     k.client_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     k.server_timestamp = 0;
-    co_await channel_.async_send(ec, leaf::serialize_keepalive(k), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::serialize_keepalive(k, options_.codec)), ec);
+}
+
+void download_session::on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec)
+{
+    auto kk = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
+    if (!kk.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return;
+    }
+    LOG_DEBUG("{} on_keepalive client {} server_timestamp {} client_timestamp {} token {}",
+              id_,
+              kk->client_id,
+              kk->server_timestamp,
+              kk->client_timestamp,
+              token_);
+}
+
+boost::asio::awaitable<void> download_session::keepalive(boost::beast::error_code& ec)
+{
+    co_await send_keepalive(ec);
+    if (ec)
+    {
+        co_return;
+    }
     boost::beast::flat_buffer buffer;
     co_await ws_client_->read(ec, buffer);
     if (ec)
@@ -44,26 +74,16 @@ boost::asio::awaitable<void> download_session::keepalive(boost::beast::error_cod
         LOG_ERROR("{} wait keepalive error {}", id_, ec.message());
         co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
+    auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
     auto type = leaf::get_message_type(message);
     if (type != leaf::message_type::keepalive)
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         co_return;
     }
-    auto kk = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
-    if (!kk.has_value())
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
-    LOG_DEBUG("{} on_keepalive client {} server_timestamp {} client_timestamp {} token {}",
-              id_,
-              kk->client_id,
-              kk->server_timestamp,
-              kk->client_timestamp,
-              token_);
+    on_keepalive(message, ec);
 }
+
 boost::asio::awaitable<void> download_session::download_coro()
 {
     LOG_INFO("{} download coro startup", id_);
@@ -78,50 +98,49 @@ boost::asio::awaitable<void> download_session::download_coro()
     leaf::login_token lt;
     lt.id = 0x01;
     lt.token = token_;
-    auto bytes = leaf::serialize_login_token(lt);
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    leaf::fill_hello(lt);
+    // 协商之前使用 json, 旧版本服务端也能解析
+    auto bytes = leaf::serialize_login_token(lt, leaf::codec_format::json);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
     if (ec)
     {
         LOG_ERROR("{} download coro send login token error {}", id_, ec.message());
         co_return;
     }
+    co_await wait_login(lt, ec);
+    if (ec)
+    {
+        co_return;
+    }
+    if (options_.has(leaf::kCapMultiplex))
+    {
+        co_await multiplex_download(ec);
+    }
+    else
+    {
+        co_await sequential_download(ec);
+    }
+    LOG_INFO("{} download coro shutdown", id_);
+}
+
+boost::asio::awaitable<void> download_session::write_coro()
+{
     while (true)
     {
-        // padding files empty will send keepalive message
-        if (padding_files_.empty())
-        {
-            co_await keepalive(ec);
-        }
+        boost::system::error_code ec;
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
-            LOG_ERROR("{} download keepalive error {}", id_, ec.message());
+            LOG_ERROR("{} write_coro error {}", id_, ec.message());
             break;
         }
-        co_await download(ec);
+        co_await ws_client_->write(ec, frame.buffers());
         if (ec)
         {
-            LOG_ERROR("{} download error {}", id_, ec.message());
+            LOG_ERROR("{} write_coro error {}", id_, ec.message());
             break;
         }
     }
-
-    LOG_INFO("{} download coro shutdown", id_);
-}
-
-boost::asio::awaitable<void> download_session::write_coro()
-{
-    boost::system::error_code ec;
-    auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-    if (ec)
-    {
-        LOG_ERROR("{} write_coro error {}", id_, ec.message());
-        co_return;
-    }
-    co_await ws_client_->write(ec, bytes.data(), bytes.size());
-    if (ec)
-    {
-        LOG_ERROR("{} write_coro error {}", id_, ec.message());
-    }
 }
 
 void download_session::shutdown()
@@ -132,6 +151,8 @@ void download_session::shutdown()
 
 boost::asio::awaitable<void> download_session::shutdown_coro()
 {
+    stopped_ = true;
+    wakeup_.cancel();
     if (ws_client_)
     {
         channel_.close();
@@ -142,31 +163,35 @@ boost::asio::awaitable<void> download_session::shutdown_coro()
     co_return;
 }
 
-boost::asio::awaitable<void> download_session::download(boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_session::sequential_download(boost::beast::error_code& ec)
 {
-    while (true)
+    // 旧版本服务端, 每次只传输一个文件
+    while (!stopped_)
     {
-        co_await keepalive(ec);
-        if (ec)
-        {
-            LOG_ERROR("{} download keepalive error {}", id_, ec.message());
-            break;
-        }
-        if (!padding_files_.empty())
+        // padding files empty will send keepalive message
+        if (padding_files_.empty())
         {
-            break;
+            co_await keepalive(ec);
+            if (ec)
+            {
+                LOG_ERROR("{} download keepalive error {}", id_, ec.message());
+                break;
+            }
+            wakeup_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            ec = {};
+            continue;
         }
-        auto file = padding_files_.front();
-        padding_files_.pop();
+        auto task = padding_files_.pop();
         // send download file request
-        co_await send_download_file_request(file, ec);
+        co_await send_download_file_request(0, task, ec);
         if (ec)
         {
             LOG_ERROR("{} send download file request error {}", id_, ec.message());
             break;
         }
         // wait download file response
-        auto ctx = co_await wait_download_file_response(ec);
+        auto ctx = co_await wait_download_file_response(task, ec);
         if (ec)
         {
             LOG_ERROR("{} wait download file response error {}", id_, ec.message());
@@ -194,35 +219,292 @@ boost::asio::awaitable<void> download_session::download(boost::beast::error_code
             break;
         }
     }
-    co_return;
 }
 
-boost::asio::awaitable<void> download_session::send_download_file_request(const std::string& filename, boost::beast::error_code& ec)
+boost::asio::awaitable<void> download_session::multiplex_download(boost::beast::error_code& ec)
+{
+    boost::asio::co_spawn(io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await recv_coro(); }, boost::asio::detached);
+    while (!stopped_)
+    {
+        // 最多 kTransferStreams 个文件同时传输
+        while (!padding_files_.empty() && streams_.size() < kTransferStreams)
+        {
+            auto task = padding_files_.pop();
+            auto stream = ++stream_seq_;
+            auto done = std::make_shared<done_channel>(io_, 1);
+            streams_[stream].task = task;
+            streams_[stream].done = done;
+            boost::asio::co_spawn(
+                io_,
+                [this, self = shared_from_this(), stream, task, done]() -> boost::asio::awaitable<void>
+                {
+                    boost::beast::error_code ec;
+                    co_await download_file(stream, task, *done, ec);
+                    streams_.erase(stream);
+                    wakeup_.cancel();
+                },
+                boost::asio::detached);
+        }
+        if (padding_files_.empty() && streams_.empty())
+        {
+            co_await send_keepalive(ec);
+            if (ec)
+            {
+                LOG_ERROR("{} download keepalive error {}", id_, ec.message());
+                break;
+            }
+        }
+        wakeup_.expires_at(boost::asio::steady_timer::time_point::max());
+        co_await wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        ec = {};
+    }
+}
+
+boost::asio::awaitable<void> download_session::download_file(uint32_t stream,
+                                                             const download_task& task,
+                                                             done_channel& done,
+                                                             boost::beast::error_code& ec)
+{
+    const auto& filename = task.filename;
+    auto request = task;
+    // 先只请求第一个块, 收到文件大小后再把剩余的块分给其他连接
+    if (task.length == 0 && options_.has(leaf::kCapRangedDownload) && !stripes_.empty())
+    {
+        request.length = kStripeChunkSize;
+    }
+    co_await send_download_file_request(stream, request, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} send download file request stream {} error {}", id_, stream, ec.message());
+        co_return;
+    }
+    // 响应和数据由 recv_coro 处理, 这里只等待结果
+    co_await done.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec)
+    {
+        LOG_ERROR("{} download file {} stream {} error {}", id_, filename, stream, ec.message());
+        co_return;
+    }
+    LOG_INFO("{} download file {} stream {} complete", id_, filename, stream);
+}
+
+void download_session::finish_stream(leaf::download_session::stream_context& sc, boost::system::error_code ec)
+{
+    if (sc.ctx.writer)
+    {
+        auto close_ec = sc.ctx.writer->close();
+        if (close_ec)
+        {
+            LOG_ERROR("{} stream {} writer close error {}", id_, sc.ctx.stream, close_ec.message());
+        }
+        sc.ctx.writer.reset();
+        if (!ec && sc.ctx.file && sc.ctx.file->offset != static_cast<int64_t>(sc.ctx.end))
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::message_size);
+        }
+    }
+    if (!ec && !sc.ctx.file)
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+    }
+    // 同一个 stream 只通知一次
+    sc.ctx.file.reset();
+    sc.done->try_send(ec);
+}
+
+boost::asio::awaitable<void> download_session::recv_coro()
+{
+    boost::beast::error_code ec;
+    boost::beast::flat_buffer buffer;
+    while (true)
+    {
+        buffer.consume(buffer.size());
+        co_await ws_client_->read(ec, buffer);
+        if (ec)
+        {
+            LOG_ERROR("{} recv coro error {}", id_, ec.message());
+            break;
+        }
+        auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
+        auto type = leaf::get_message_type(message);
+        if (type == leaf::message_type::keepalive)
+        {
+            on_keepalive(message, ec);
+            if (ec)
+            {
+                break;
+            }
+            continue;
+        }
+        auto stream = leaf::get_message_stream(message);
+        auto it = streams_.find(stream);
+        if (it == streams_.end() && type == leaf::message_type::file_data)
+        {
+            // 已经结束的 stream 丢弃数据, 仍然归还信用, 服务端才能发送完
+            co_await send_credit(stream, 1, ec);
+            if (ec)
+            {
+                break;
+            }
+            continue;
+        }
+        if (it == streams_.end())
+        {
+            LOG_ERROR("{} recv coro message {} unknown stream {}", id_, static_cast<int>(type), stream);
+            continue;
+        }
+        auto& sc = it->second;
+        // 单个 stream 的错误只结束这个 stream
+        boost::beast::error_code stream_ec;
+        if (type == leaf::message_type::download_file_response)
+        {
+            sc.ctx = co_await on_download_file_response(sc.task, message, stream_ec);
+            sc.ctx.stream = stream;
+            if (!stream_ec && sc.task.length == 0 && sc.ctx.response.length != 0)
+            {
+                stripe_file(sc.task, sc.ctx);
+            }
+        }
+        else if (type == leaf::message_type::file_data)
+        {
+            // 出错的 stream 丢弃还在路上的数据
+            if (sc.ctx.writer)
+            {
+                co_await on_file_data(sc.ctx, message, stream_ec);
+            }
+            co_await grant_credit(stream, sc.credits, ec);
+            if (ec)
+            {
+                break;
+            }
+        }
+        else if (type == leaf::message_type::done)
+        {
+            finish_stream(sc, {});
+        }
+        else if (type == leaf::message_type::error)
+        {
+            auto e = leaf::deserialize_error_message(std::vector<uint8_t>(message.begin(), message.end()));
+            stream_ec = boost::system::error_code(e.has_value() ? e->error : EPROTO, boost::system::generic_category());
+        }
+        else
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+            LOG_ERROR("{} recv coro unexpected message {} stream {}", id_, static_cast<int>(type), stream);
+            break;
+        }
+        if (stream_ec)
+        {
+            finish_stream(sc, stream_ec);
+        }
+    }
+    // 连接断开, 唤醒所有等待中的 stream
+    for (auto& [stream, sc] : streams_)
+    {
+        sc.done->close();
+    }
+    stopped_ = true;
+    wakeup_.cancel();
+}
+
+boost::asio::awaitable<void> download_session::grant_credit(uint32_t stream, uint32_t& credits, boost::beast::error_code& ec)
+{
+    // 数据写入文件后归还, 攒够窗口的四分之一再发送
+    credits++;
+    if (credits < std::max<uint32_t>(options_.window / 4, 1))
+    {
+        co_return;
+    }
+    auto count = credits;
+    credits = 0;
+    co_await send_credit(stream, count, ec);
+}
+
+boost::asio::awaitable<void> download_session::send_credit(uint32_t stream, uint32_t count, boost::beast::error_code& ec)
+{
+    if (!options_.has(leaf::kCapCreditFlow))
+    {
+        co_return;
+    }
+    auto bytes = leaf::serialize_credit(leaf::credit{count}, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+}
+
+boost::asio::awaitable<void> download_session::send_download_file_request(uint32_t stream,
+                                                                          const download_task& task,
+                                                                          boost::beast::error_code& ec)
 {
     leaf::download_file_request req;
-    req.filename = filename;
+    req.filename = task.filename;
     req.id = ++seq_;
-    LOG_INFO("{} download_file {}", id_, req.filename);
-    co_await channel_.async_send(ec, leaf::serialize_download_file_request(req), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    req.offset = task.offset;
+    req.length = task.length;
+    // 本地已有同名文件时带上每个完整窗口的 hash, 服务端校验后从不一致的位置开始发送
+    if (task.offset == 0 && options_.has(leaf::kCapResumeDownload))
+    {
+        req.hashes = co_await local_window_hashes(std::filesystem::path(task.filename).string());
+    }
+    LOG_INFO("{} download_file {} stream {} range {} {} hashes {}", id_, req.filename, stream, req.offset, req.length, req.hashes.size());
+    auto bytes = leaf::serialize_download_file_request(req, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
-boost::asio::awaitable<leaf::download_session::download_context> download_session::wait_download_file_response(boost::beast::error_code& ec)
+boost::asio::awaitable<std::vector<std::string>> download_session::local_window_hashes(const std::string& file_path)
+{
+    boost::system::error_code ec;
+    const uint64_t window = static_cast<uint64_t>(options_.block_size) * options_.hash_block_count;
+    auto hashes = co_await leaf::dio::instance().run(
+        file_path,
+        [&]() -> std::vector<std::string>
+        {
+            if (!std::filesystem::exists(file_path, ec) || ec)
+            {
+                return {};
+            }
+            auto file_size = std::filesystem::file_size(file_path, ec);
+            if (ec)
+            {
+                return {};
+            }
+            // 请求大小有限, 只校验前面的 kMaxResumeHashes 个窗口
+            return leaf::hash_file_windows(file_path, window, std::min<uint64_t>(file_size / window, kMaxResumeHashes), ec);
+        });
+    // 计算失败时按没有本地文件处理, 重新下载整个文件
+    if (ec)
+    {
+        LOG_ERROR("{} hash local file {} error {}", id_, file_path, ec.message());
+        co_return std::vector<std::string>{};
+    }
+    co_return hashes;
+}
+
+boost::asio::awaitable<leaf::download_session::download_context> download_session::wait_download_file_response(const download_task& task,
+                                                                                                                boost::beast::error_code& ec)
 {
-    leaf::download_session::download_context ctx;
     boost::beast::flat_buffer buffer;
     co_await ws_client_->read(ec, buffer);
     if (ec)
     {
         LOG_ERROR("{} wait download file response error {}", id_, ec.message());
-        co_return ctx;
+        co_return leaf::download_session::download_context{};
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
+    auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
     auto type = leaf::get_message_type(message);
     if (type != leaf::message_type::download_file_response)
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return ctx;
+        co_return leaf::download_session::download_context{};
     }
+    co_return co_await on_download_file_response(task, message, ec);
+}
+
+boost::asio::awaitable<leaf::download_session::download_context> download_session::on_download_file_response(const download_task& task,
+                                                                                                              std::span<const uint8_t> message,
+                                                                                                              boost::beast::error_code& ec)
+{
+    leaf::download_session::download_context ctx;
     auto download_response = leaf::deserialize_download_file_response(std::vector<uint8_t>(message.begin(), message.end()));
     if (!download_response.has_value())
     {
@@ -231,19 +513,37 @@ boost::asio::awaitable<leaf::download_session::download_context> download_sessio
     }
     leaf::download_file_response response = download_response.value();
     auto file_path = std::filesystem::path(response.filename).string();
-    bool exists = std::filesystem::exists(file_path, ec);
+    // 后面的范围写入其他连接已经创建的文件, 只在第一个范围检查本地文件
+    bool exists = false;
+    if (task.offset == 0)
+    {
+        exists = co_await leaf::dio::instance().run(file_path, [&]() { return std::filesystem::exists(file_path, ec); });
+    }
     if (ec)
     {
         co_return ctx;
     }
     if (exists)
     {
-        uint32_t exists_size = std::filesystem::file_size(file_path, ec);
+        auto exists_size = co_await leaf::dio::instance().run(file_path, [&]() { return std::filesystem::file_size(file_path, ec); });
         if (ec)
         {
             co_return ctx;
         }
-        if (exists_size != response.filesize)
+        if (options_.has(leaf::kCapResumeDownload))
+        {
+            // 服务端校验过的前缀保留, 之后的数据丢弃重新下载
+            if (exists_size != response.offset)
+            {
+                LOG_INFO("{} download file {} local size {} resume from {}", id_, file_path, exists_size, response.offset);
+                co_await leaf::dio::instance().run(file_path, [&]() { std::filesystem::resize_file(file_path, response.offset, ec); });
+                if (ec)
+                {
+                    co_return ctx;
+                }
+            }
+        }
+        else if (exists_size != response.filesize)
         {
             ec = boost::system::errc::make_error_code(boost::system::errc::no_such_process);
             co_return ctx;
@@ -254,8 +554,18 @@ boost::asio::awaitable<leaf::download_session::download_context> download_sessio
     file->filename = response.filename;
     file->file_size = response.filesize;
     file->file_path = file_path;
+    file->offset = static_cast<int64_t>(response.offset);
+    ctx.end = response.length != 0 ? response.offset + response.length : response.filesize;
     ctx.response = response;
     ctx.file = file;
+    ctx.hash = std::make_shared<leaf::blake2b>();
+    ctx.writer = std::make_shared<leaf::async_file_writer>(io_.get_executor(), ctx.file->file_path);
+    ec = ctx.writer->open();
+    if (ec)
+    {
+        LOG_ERROR("{} download file {} writer open error {}", id_, ctx.file->file_path, ec.message());
+        ctx.writer.reset();
+    }
     co_return ctx;
 }
 
@@ -286,83 +596,91 @@ boost::asio::awaitable<void> download_session::wait_ack(boost::beast::error_code
 
 boost::asio::awaitable<void> download_session::wait_file_data(leaf::download_session::download_context& ctx, boost::beast::error_code& ec)
 {
-    auto writer = std::make_shared<leaf::file_writer>(ctx.file->file_path);
-    ec = writer->open();
-    if (ec)
-    {
-        LOG_ERROR("{} wait file data writer open error {}", id_, ec.message());
-        co_return;
-    }
-
-    auto hash = std::make_shared<leaf::blake2b>();
-
-    while (true)
+    // 接收缓冲区在循环内复用, 数据直接从缓冲区写入磁盘
+    boost::beast::flat_buffer buffer;
+    while (ctx.file->offset < static_cast<int64_t>(ctx.end))
     {
-        boost::beast::flat_buffer buffer;
-        leaf::download_file_response response;
+        buffer.consume(buffer.size());
         co_await ws_client_->read(ec, buffer);
         if (ec)
         {
-            LOG_ERROR("{} wait ack error {}", id_, ec.message());
+            LOG_ERROR("{} wait file data error {}", id_, ec.message());
             break;
         }
-        auto message = boost::beast::buffers_to_string(buffer.data());
+        auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
         auto type = leaf::get_message_type(message);
         if (type != leaf::message_type::file_data)
         {
             ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
             break;
         }
-        auto data = leaf::deserialize_file_data(std::vector<uint8_t>(message.begin(), message.end()));
-        if (!data.has_value())
+        co_await on_file_data(ctx, message, ec);
+        if (ec)
         {
-            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
             break;
         }
+    }
+    auto close_ec = ctx.writer->close();
+    if (close_ec)
+    {
+        LOG_ERROR("{} wait file data writer close error {}", id_, close_ec.message());
+    }
+    if (!ec)
+    {
+        ec = close_ec;
+    }
+}
 
-        writer->write_at(ctx.file->offset, data->data.data(), data->data.size(), ec);
-        if (ec)
+boost::asio::awaitable<void> download_session::on_file_data(leaf::download_session::download_context& ctx,
+                                                            std::span<const uint8_t> message,
+                                                            boost::beast::error_code& ec)
+{
+    auto data = leaf::deserialize_file_data_view(message);
+    if (!data.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    auto& writer = ctx.writer;
+    co_await writer->write_at(ctx.file->offset, data->data.data(), data->data.size(), ec);
+    if (ec)
+    {
+        LOG_ERROR("{} download file {} writer write error {}", id_, ctx.file->file_path, ec.message());
+        co_return;
+    }
+    ctx.file->offset += static_cast<int64_t>(data->data.size());
+    ctx.file->hash_count++;
+    ctx.hash->update(data->data.data(), data->data.size());
+    LOG_DEBUG("{} download file {} stream {} hash count {} hash {} data size {} write size {}",
+              id_,
+              ctx.file->file_path,
+              ctx.stream,
+              ctx.file->hash_count,
+              data->hash.empty() ? "empty" : data->hash,
+              data->data.size(),
+              writer->size());
+
+    if (!data->hash.empty())
+    {
+        ctx.hash->final();
+        auto hex_str = ctx.hash->hex();
+        if (hex_str != data->hash)
         {
-            LOG_ERROR("{} wait file data writer write error {}", id_, ec.message());
-            break;
-        }
-        ctx.file->offset += static_cast<int64_t>(data->data.size());
-        ctx.file->hash_count++;
-        hash->update(data->data.data(), data->data.size());
-        LOG_DEBUG("{} download file {} hash count {} hash {} data size {} write size {}",
-                  id_,
-                  ctx.file->file_path,
-                  ctx.file->hash_count,
-                  data->hash.empty() ? "empty" : data->hash,
-                  data->data.size(),
-                  writer->size());
-
-        if (!data->hash.empty())
-        {
-            hash->final();
-            auto hex_str = hash->hex();
-            if (hex_str != data->hash)
-            {
-                LOG_ERROR("{} download file {} hash not match {} {}", id_, ctx.file->file_path, hex_str, data->hash);
-                break;
-            }
-            ctx.file->hash_count = 0;
-            hash = std::make_shared<leaf::blake2b>();
-        }
-        download_event d;
-        d.filename = ctx.file->filename;
-        d.download_size = writer->size();
-        d.file_size = ctx.file->file_size;
-        emit_event(d);
-        if (ctx.file->file_size == writer->size())
-        {
-            LOG_INFO("{} download file {} size {} done", id_, ctx.file->file_path, d.file_size);
+            LOG_ERROR("{} download file {} hash not match {} {}", id_, ctx.file->file_path, hex_str, data->hash);
+            ec = boost::system::errc::make_error_code(boost::system::errc::bad_message);
+            co_return;
         }
+        ctx.file->hash_count = 0;
+        ctx.hash = std::make_shared<leaf::blake2b>();
     }
-    ec = writer->close();
-    if (ec)
+    download_event d;
+    d.filename = ctx.file->filename;
+    d.download_size = writer->size();
+    d.file_size = ctx.end - ctx.response.offset;
+    emit_event(d);
+    if (d.file_size == writer->size())
     {
-        LOG_ERROR("{} wait file data writer close error {}", id_, ec.message());
+        LOG_INFO("{} download file {} size {} done", id_, ctx.file->file_path, d.file_size);
     }
 }
 
@@ -397,24 +715,91 @@ void download_session::emit_event(const leaf::download_event& e) const
     }
 }
 
-void download_session::safe_add_file(const std::string& filename) { padding_files_.push(filename); }
+void download_session::safe_add_tasks(const std::vector<download_task>& tasks)
+{
+    for (const auto& task : tasks)
+    {
+        padding_files_.push(task);
+    }
+    wakeup_.cancel();
+}
 
-void download_session::safe_add_files(const std::vector<std::string>& files)
+void download_session::add_range(const std::string& filename, uint64_t offset, uint64_t length, leaf::transfer_priority priority)
 {
-    for (const auto& filename : files)
+    std::vector<download_task> tasks{download_task{filename, offset, length, length, priority}};
+    io_.post([this, tasks, self = shared_from_this()]() { safe_add_tasks(tasks); });
+}
+
+void download_session::set_priority(const std::string& filename, leaf::transfer_priority priority)
+{
+    io_.post([this, filename, priority, self = shared_from_this()]() { padding_files_.set_priority(filename, priority); });
+}
+
+void download_session::set_smallest_first(bool enable)
+{
+    io_.post([this, enable, self = shared_from_this()]() { padding_files_.set_smallest_first(enable); });
+}
+
+void download_session::set_stripes(std::vector<std::shared_ptr<leaf::download_session>> stripes) { stripes_ = std::move(stripes); }
+
+void download_session::stripe_file(const download_task& task, const leaf::download_session::download_context& ctx)
+{
+    const auto& filename = task.filename;
+    if (ctx.end >= ctx.file->file_size)
     {
-        padding_files_.push(filename);
+        return;
     }
+    // 第一个块由当前 stream 下载, 剩余的块轮流分给各个连接, 包括当前连接
+    uint64_t offset = ctx.end;
+    std::size_t index = 0;
+    while (offset < ctx.file->file_size)
+    {
+        auto length = std::min<uint64_t>(kStripeChunkSize, ctx.file->file_size - offset);
+        index = (index + 1) % (stripes_.size() + 1);
+        if (index == 0)
+        {
+            safe_add_tasks({download_task{filename, offset, length, length, task.priority}});
+        }
+        else
+        {
+            stripes_[index - 1]->add_range(filename, offset, length, task.priority);
+        }
+        offset += length;
+    }
+    LOG_INFO("{} download file {} size {} striped chunk size {}", id_, filename, ctx.file->file_size, kStripeChunkSize);
 }
 
-void download_session::add_file(const std::string& file)
+void download_session::add_file(const std::string& file, leaf::transfer_priority priority, uint64_t size)
 {
-    io_.post([this, file, self = shared_from_this()]() { safe_add_file(file); });
+    std::vector<download_task> tasks{download_task{file, 0, 0, size, priority}};
+    io_.post([this, tasks, self = shared_from_this()]() { safe_add_tasks(tasks); });
 }
 
-void download_session::add_files(const std::vector<std::string>& files)
+void download_session::add_files(const std::vector<std::string>& files, leaf::transfer_priority priority)
 {
-    io_.post([this, files, self = shared_from_this()]() { safe_add_files(files); });
+    std::vector<download_task> tasks;
+    tasks.reserve(files.size());
+    for (const auto& filename : files)
+    {
+        tasks.push_back(download_task{filename, 0, 0, 0, priority});
+    }
+    io_.post([this, tasks, self = shared_from_this()]() { safe_add_tasks(tasks); });
+}
+
+boost::asio::awaitable<void> download_session::wait_login(const leaf::login_token& hello, boost::beast::error_code& ec)
+{
+    co_await leaf::read_login(*ws_client_, hello, options_, nullptr, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} wait login error {}", id_, ec.message());
+        co_return;
+    }
+    LOG_INFO("{} login success version {} capabilities {} block size {} window {}",
+             id_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
 }
 
 }    // namespace leaf
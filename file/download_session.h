@@ -1,14 +1,22 @@
 #ifndef LEAF_FILE_DOWNLOAD_SESSION_H
 #define LEAF_FILE_DOWNLOAD_SESSION_H
 
+#include <map>
+#include <span>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <boost/asio/experimental/channel.hpp>
 
 #include "file/file.h"
 #include "file/event.h"
 #include "crypt/blake2b.h"
+#include "file/async_file.h"
 #include "protocol/message.h"
+#include "protocol/capability.h"
 #include "file/file_context.h"
+#include "file/transfer_queue.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/plain_websocket_client.h"
 
 namespace leaf
@@ -17,8 +25,30 @@ class download_session : public std::enable_shared_from_this<download_session>
 {
     struct download_context
     {
+        uint32_t stream = 0;
+        uint64_t end = 0;    // 本次下载范围的结束位置
         std::shared_ptr<leaf::file_info> file;
         leaf::download_file_response response;
+        std::shared_ptr<leaf::blake2b> hash;
+        std::shared_ptr<leaf::async_file_writer> writer;
+    };
+    // 待下载的文件, length 不为 0 时只下载文件的一个范围
+    struct download_task
+    {
+        std::string filename;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        uint64_t size = 0;    // 排队使用的大小, 0 表示未知
+        leaf::transfer_priority priority = leaf::transfer_priority::bulk;
+    };
+    // stream 结束时通知发起下载的协程
+    using done_channel = boost::asio::experimental::channel<void(boost::system::error_code)>;
+    struct stream_context
+    {
+        leaf::download_session::download_task task;
+        leaf::download_session::download_context ctx;
+        std::shared_ptr<done_channel> done;
+        uint32_t credits = 0;    // 已写入还没有归还的信用
     };
 
    public:
@@ -31,37 +61,73 @@ class download_session : public std::enable_shared_from_this<download_session>
     void startup();
     void shutdown();
     void update();
-    void add_file(const std::string &file);
-    void add_files(const std::vector<std::string> &files);
+    // 远端文件的大小未知, 需要小文件优先时由调用者提供 size
+    void add_file(const std::string &file, leaf::transfer_priority priority = leaf::transfer_priority::bulk, uint64_t size = 0);
+    void add_files(const std::vector<std::string> &files, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    void add_range(const std::string &filename,
+                   uint64_t offset,
+                   uint64_t length,
+                   leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    // 修改还在排队的文件的优先级, 已经开始传输的不受影响
+    void set_priority(const std::string &filename, leaf::transfer_priority priority);
+    void set_smallest_first(bool enable);
+    // 大文件的其他范围交给这些连接并发下载
+    void set_stripes(std::vector<std::shared_ptr<leaf::download_session>> stripes);
 
    public:
     boost::asio::awaitable<void> download_coro();
     boost::asio::awaitable<void> write_coro();
+    boost::asio::awaitable<void> recv_coro();
+    boost::asio::awaitable<void> wait_login(const leaf::login_token &hello, boost::beast::error_code &ec);
     boost::asio::awaitable<void> shutdown_coro();
     boost::asio::awaitable<void> keepalive(boost::beast::error_code &ec);
-    boost::asio::awaitable<void> download(boost::beast::error_code &ec);
-    boost::asio::awaitable<void> send_download_file_request(const std::string &filename, boost::beast::error_code &ec);
-    boost::asio::awaitable<leaf::download_session::download_context> wait_download_file_response(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_keepalive(boost::beast::error_code &ec);
+    void on_keepalive(std::span<const uint8_t> message, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> sequential_download(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> multiplex_download(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> download_file(uint32_t stream, const download_task &task, done_channel &done, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_download_file_request(uint32_t stream, const download_task &task, boost::beast::error_code &ec);
+    boost::asio::awaitable<std::vector<std::string>> local_window_hashes(const std::string &file_path);
+    boost::asio::awaitable<leaf::download_session::download_context> wait_download_file_response(const download_task &task,
+                                                                                                  boost::beast::error_code &ec);
+    boost::asio::awaitable<leaf::download_session::download_context> on_download_file_response(const download_task &task,
+                                                                                                std::span<const uint8_t> message,
+                                                                                                boost::beast::error_code &ec);
     boost::asio::awaitable<void> wait_ack(boost::beast::error_code &ec);
     boost::asio::awaitable<void> wait_file_data(leaf::download_session::download_context &ctx, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> on_file_data(leaf::download_session::download_context &ctx,
+                                              std::span<const uint8_t> message,
+                                              boost::beast::error_code &ec);
     boost::asio::awaitable<void> wait_file_done(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> grant_credit(uint32_t stream, uint32_t &credits, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_credit(uint32_t stream, uint32_t count, boost::beast::error_code &ec);
+    void finish_stream(leaf::download_session::stream_context &sc, boost::system::error_code ec);
 
    private:
-    void safe_add_file(const std::string &filename);
-    void safe_add_files(const std::vector<std::string> &files);
+    void safe_add_tasks(const std::vector<download_task> &tasks);
+    void stripe_file(const download_task &task, const leaf::download_session::download_context &ctx);
     void emit_event(const leaf::download_event &) const;
 
    private:
     uint32_t seq_ = 0;
+    uint32_t stream_seq_ = 0;
+    bool stopped_ = false;
     std::string id_;
     std::string host_;
     std::string port_;
     std::string token_;
+    leaf::session_options options_;
     boost::asio::io_context &io_;
     leaf::download_handle progress_cb_;
-    std::queue<std::string> padding_files_;
+    leaf::transfer_queue<download_task> padding_files_;
+    std::vector<std::shared_ptr<leaf::download_session>> stripes_;
     std::shared_ptr<leaf::plain_websocket_client> ws_client_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    // 等待新文件或 stream 结束
+    boost::asio::steady_timer wakeup_{io_};
+    std::map<uint32_t, leaf::download_session::stream_context> streams_;
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 }    // namespace leaf
 
@@ -22,14 +22,17 @@ leaf::websocket_handle::ptr websocket_handle(const boost::asio::any_io_executor
     LOG_INFO("{} websocket handle target {}", id, target);
     if (boost::ends_with(target, "upload"))
     {
+        session->apply_socket_profile(leaf::socket_presets::instance().bulk());
         return std::make_shared<upload_file_handle>(io, id, session);
     }
     if (boost::ends_with(target, "download"))
     {
+        session->apply_socket_profile(leaf::socket_presets::instance().bulk());
         return std::make_shared<download_file_handle>(io, id, session);
     }
     if (boost::ends_with(target, "cotrol"))
     {
+        session->apply_socket_profile(leaf::socket_presets::instance().control());
         return std::make_shared<cotrol_file_handle>(io, id, session);
     }
     return nullptr;
@@ -68,7 +71,7 @@ void http_handle(const leaf::http_session::ptr &session, const leaf::http_sessio
     boost::beast::http::response<boost::beast::http::string_body> response;
     response.result(boost::beast::http::status::ok);
     response.set(boost::beast::http::field::content_type, "text/plain");
-    auto token_msg = leaf::serialize_login_token(l);
+    auto token_msg = leaf::serialize_login_token(l, leaf::get_message_codec(data2));
     response.body().assign(token_msg.begin(), token_msg.end());
     response.prepare_payload();
     response.keep_alive(false);
@@ -1,4 +1,5 @@
 #include "log/log.h"
+#include "config/config.h"
 #include "crypt/random.h"
 #include "net/http_client.h"
 #include "protocol/message.h"
@@ -26,7 +27,8 @@ void file_transfer_client::do_login()
     l.username = user_;
     l.password = pass_;
     std::string login_url = "http://" + ed_.address().to_string() + ":" + std::to_string(ed_.port()) + "/leaf/login";
-    auto data = leaf::serialize_login_request(l);
+    // 登录在能力协商之前, 使用 json 兼容旧版本服务端
+    auto data = leaf::serialize_login_request(l, leaf::codec_format::json);
     c->post(login_url,
             std::string(data.begin(), data.end()),
             [this, c](boost::beast::error_code ec, const std::string &res)
@@ -61,9 +63,29 @@ void file_transfer_client::on_login(boost::beast::error_code ec, const std::stri
     cotrol_ = std::make_shared<leaf::cotrol_session>("cotrol", host_, port_, l->token, handler_.c, executors.get_executor());
     upload_ = std::make_shared<leaf::upload_session>("upload", host_, port_, l->token, handler_.u, executors.get_executor());
     download_ = std::make_shared<leaf::download_session>("download", host_, port_, l->token, handler_.d, executors.get_executor());
+    for (int i = 1; i < kStripeConnections; i++)
+    {
+        auto id = "upload-" + std::to_string(i);
+        upload_stripes_.push_back(std::make_shared<leaf::upload_session>(id, host_, port_, l->token, handler_.u, executors.get_executor()));
+    }
+    for (int i = 1; i < kStripeConnections; i++)
+    {
+        auto id = "download-" + std::to_string(i);
+        download_stripes_.push_back(std::make_shared<leaf::download_session>(id, host_, port_, l->token, handler_.d, executors.get_executor()));
+    }
+    upload_->set_stripes(upload_stripes_);
+    download_->set_stripes(download_stripes_);
     cotrol_->startup();
     upload_->startup();
+    for (const auto &stripe : upload_stripes_)
+    {
+        stripe->startup();
+    }
     download_->startup();
+    for (const auto &stripe : download_stripes_)
+    {
+        stripe->startup();
+    }
     start_timer();
 }
 
@@ -87,11 +109,21 @@ void file_transfer_client::safe_shutdown()
         upload_->shutdown();
         upload_.reset();
     }
+    for (const auto &stripe : upload_stripes_)
+    {
+        stripe->shutdown();
+    }
+    upload_stripes_.clear();
     if (download_)
     {
         download_->shutdown();
         download_.reset();
     }
+    for (const auto &stripe : download_stripes_)
+    {
+        stripe->shutdown();
+    }
+    download_stripes_.clear();
     if (cotrol_)
     {
         cotrol_->shutdown();
@@ -110,47 +142,77 @@ void file_transfer_client::login(const std::string &user, const std::string &pas
             do_login();
         });
 }
-void file_transfer_client::add_upload_file(const std::string &filename)
+void file_transfer_client::add_upload_file(const std::string &filename, leaf::transfer_priority priority)
+{
+    ex_->post(
+        [this, filename, priority]()
+        {
+            if (upload_)
+            {
+                upload_->add_file(filename, priority);
+            }
+        });
+}
+void file_transfer_client::add_download_file(const std::string &filename, leaf::transfer_priority priority)
 {
     ex_->post(
-        [this, filename]()
+        [this, filename, priority]()
+        {
+            if (download_)
+            {
+                download_->add_file(filename, priority);
+            }
+        });
+}
+void file_transfer_client::add_upload_files(const std::vector<std::string> &files, leaf::transfer_priority priority)
+{
+    ex_->post(
+        [this, files, priority]()
         {
             if (upload_)
             {
-                upload_->add_file(filename);
+                upload_->add_files(files, priority);
             }
         });
 }
-void file_transfer_client::add_download_file(const std::string &filename)
+void file_transfer_client::add_download_files(const std::vector<std::string> &files, leaf::transfer_priority priority)
 {
     ex_->post(
-        [this, filename]()
+        [this, files, priority]()
         {
             if (download_)
             {
-                download_->add_file(filename);
+                download_->add_files(files, priority);
             }
         });
 }
-void file_transfer_client::add_upload_files(const std::vector<std::string> &files)
+void file_transfer_client::set_transfer_priority(const std::string &filename, leaf::transfer_priority priority)
 {
     ex_->post(
-        [this, files]()
+        [this, filename, priority]()
         {
             if (upload_)
             {
-                upload_->add_files(files);
+                upload_->set_priority(filename, priority);
+            }
+            if (download_)
+            {
+                download_->set_priority(filename, priority);
             }
         });
 }
-void file_transfer_client::add_download_files(const std::vector<std::string> &files)
+void file_transfer_client::set_smallest_first(bool enable)
 {
     ex_->post(
-        [this, files]()
+        [this, enable]()
         {
+            if (upload_)
+            {
+                upload_->set_smallest_first(enable);
+            }
             if (download_)
             {
-                download_->add_files(files);
+                download_->set_smallest_first(enable);
             }
         });
 }
@@ -23,11 +23,14 @@ class file_transfer_client
 
    public:
     void login(const std::string &user, const std::string &pass);
-    void add_upload_file(const std::string &filename);
-    void add_download_file(const std::string &filename);
+    void add_upload_file(const std::string &filename, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    void add_download_file(const std::string &filename, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
 
-    void add_upload_files(const std::vector<std::string> &files);
-    void add_download_files(const std::vector<std::string> &files);
+    void add_upload_files(const std::vector<std::string> &files, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    void add_download_files(const std::vector<std::string> &files, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    // 调整还在排队的文件, 上传和下载队列都会修改
+    void set_transfer_priority(const std::string &filename, leaf::transfer_priority priority);
+    void set_smallest_first(bool enable);
     void create_directory(const std::string &dir);
     void change_current_dir(const std::string &dir);
 
@@ -59,8 +62,11 @@ class file_transfer_client
     boost::asio::ip::tcp::endpoint ed_;
     std::shared_ptr<leaf::cotrol_session> cotrol_;
     std::shared_ptr<leaf::upload_session> upload_;
+    // 分段传输大文件使用的额外连接
+    std::vector<std::shared_ptr<leaf::upload_session>> upload_stripes_;
     leaf::executors::executor *ex_;
     std::shared_ptr<leaf::download_session> download_;
+    std::vector<std::shared_ptr<leaf::download_session>> download_stripes_;
     std::shared_ptr<boost::asio::steady_timer> timer_;
 };
 
@@ -5,6 +5,7 @@
 #include "file/file.h"
 #include "file/hash_file.h"
 #include "crypt/blake2b.h"
+#include "config/config.h"
 
 namespace leaf
 {
@@ -45,4 +46,47 @@ std::string hash_file(const std::string& file, boost::system::error_code& ec)
     }
     return b.hex();
 }
+
+std::vector<std::string> hash_file_windows(const std::string& file, uint64_t window_size, uint64_t max_count, boost::system::error_code& ec)
+{
+    std::vector<std::string> hashes;
+    leaf::file_reader f(file);
+    ec = f.open();
+    if (ec)
+    {
+        return hashes;
+    }
+    std::vector<uint8_t> buffer(kBlockSize);
+    while (window_size != 0 && hashes.size() < max_count)
+    {
+        leaf::blake2b b;
+        uint64_t remain = window_size;
+        while (remain > 0)
+        {
+            auto read_size = f.read(buffer.data(), std::min<uint64_t>(remain, buffer.size()), ec);
+            if (ec)
+            {
+                break;
+            }
+            b.update(buffer.data(), read_size);
+            remain -= read_size;
+        }
+        if (remain != 0)
+        {
+            break;
+        }
+        b.final();
+        hashes.push_back(b.hex());
+    }
+    if (ec == boost::asio::error::eof)
+    {
+        ec = {};
+    }
+    auto close_ec = f.close();
+    if (!ec)
+    {
+        ec = close_ec;
+    }
+    return hashes;
+}
 }    // namespace leaf
@@ -2,11 +2,15 @@
 #define LEAF_FILE_HASH_FILE_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <boost/system/error_code.hpp>
 
 namespace leaf
 {
 std::string hash_file(const std::string& file, boost::system::error_code& ec);
+// 从文件开头按 window_size 分段计算 hash, 只计算完整的窗口, 最多 max_count 个
+std::vector<std::string> hash_file_windows(const std::string& file, uint64_t window_size, uint64_t max_count, boost::system::error_code& ec);
 }
 
 #endif
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include "file/memory_governor.h"
+
+namespace leaf
+{
+memory_governor::memory_governor() : memory_governor(kMemoryBudget) {}
+
+memory_governor::memory_governor(std::size_t budget) : budget_(std::max<std::size_t>(budget, 1)) {}
+
+boost::asio::awaitable<std::shared_ptr<const void>> memory_governor::acquire(std::size_t bytes)
+{
+    bytes = std::min(bytes, budget_);
+    auto ex = co_await boost::asio::this_coro::executor;
+    std::shared_ptr<waiter> wakeup;
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        // 有等待者时排在后面, 大消息不会被小消息饿死
+        if (waiters_.empty() && used_ + bytes <= budget_)
+        {
+            used_ += bytes;
+            high_water_ = std::max(high_water_, used_);
+            co_return make_lease(bytes);
+        }
+        wakeup = std::make_shared<waiter>(ex, 1);
+        waiters_.push_back(pending{bytes, wakeup});
+    }
+    // release 已经替等待者记账
+    boost::system::error_code ec;
+    co_await wakeup->async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_return make_lease(bytes);
+}
+
+std::shared_ptr<const void> memory_governor::make_lease(std::size_t bytes)
+{
+    return {nullptr, [this, bytes](const void*) { release(bytes); }};
+}
+
+void memory_governor::release(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    used_ -= bytes;
+    while (!waiters_.empty() && used_ + waiters_.front().bytes <= budget_)
+    {
+        auto next = std::move(waiters_.front());
+        waiters_.pop_front();
+        used_ += next.bytes;
+        high_water_ = std::max(high_water_, used_);
+        // 容量为 1, 等待者还没开始接收时通知也不会丢失
+        next.wakeup->try_send(boost::system::error_code{});
+    }
+}
+
+std::size_t memory_governor::budget() const { return budget_; }
+
+std::size_t memory_governor::usage() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return used_;
+}
+
+std::size_t memory_governor::high_water() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return high_water_;
+}
+
+}    // namespace leaf
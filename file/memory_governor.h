@@ -0,0 +1,90 @@
+#ifndef LEAF_FILE_MEMORY_GOVERNOR_H
+#define LEAF_FILE_MEMORY_GOVERNOR_H
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/concurrent_channel.hpp>
+#include "util/singleton.h"
+#include "config/config.h"
+#include "net/executor_load.h"
+#include "net/websocket_frame.h"
+
+namespace leaf
+{
+// 进程内所有发送通道共用的内存预算
+// 消息写入发送通道前申请额度, 预算不足时按申请顺序挂起, 消息写完后随 frame 释放
+class memory_governor
+{
+    using waiter = boost::asio::experimental::concurrent_channel<void(boost::system::error_code)>;
+    struct pending
+    {
+        std::size_t bytes = 0;
+        std::shared_ptr<waiter> wakeup;
+    };
+
+   public:
+    memory_governor();
+    explicit memory_governor(std::size_t budget);
+
+   public:
+    // 返回的额度析构时归还, 超过总预算的消息按总预算计算
+    boost::asio::awaitable<std::shared_ptr<const void>> acquire(std::size_t bytes);
+    [[nodiscard]] std::size_t budget() const;
+    [[nodiscard]] std::size_t usage() const;
+    [[nodiscard]] std::size_t high_water() const;
+
+   private:
+    void release(std::size_t bytes);
+    std::shared_ptr<const void> make_lease(std::size_t bytes);
+
+   private:
+    mutable std::mutex mutex_;
+    std::size_t budget_ = 0;
+    std::size_t used_ = 0;
+    std::size_t high_water_ = 0;
+    std::deque<pending> waiters_;
+};
+
+using mem = singleton<memory_governor>;
+
+// 连接的额度和进程的额度, 按成员逆序释放, 连接的额度先于连接的预算对象释放
+// 同时计入所在 executor 的待发送字节, 用于选择 executor
+struct governed_lease
+{
+    governed_lease(leaf::executor_load& l, std::size_t n) : load(l), bytes(static_cast<int64_t>(n)) { load.add_queued(bytes); }
+    ~governed_lease() { load.add_queued(-bytes); }
+    governed_lease(const governed_lease&) = delete;
+    governed_lease& operator=(const governed_lease&) = delete;
+
+    leaf::executor_load& load;
+    int64_t bytes = 0;
+    std::shared_ptr<memory_governor> connection;
+    std::shared_ptr<const void> local;
+    std::shared_ptr<const void> global;
+};
+
+// 先申请连接的额度再申请进程的额度, 然后写入发送通道
+// 小的控制消息不申请额度, 不会排在被阻塞的数据后面
+template <typename Channel>
+boost::asio::awaitable<void> governed_send(Channel& channel,
+                                           const std::shared_ptr<memory_governor>& connection,
+                                           leaf::websocket_frame frame,
+                                           boost::system::error_code& ec)
+{
+    if (frame.payload.size() != 0 || frame.size() > kControlFrameSize)
+    {
+        auto lease = std::make_shared<governed_lease>(leaf::executor_load::of(co_await boost::asio::this_coro::executor), frame.size());
+        lease->connection = connection;
+        lease->local = co_await connection->acquire(frame.size());
+        lease->global = co_await leaf::mem::instance().acquire(frame.size());
+        frame.lease = std::move(lease);
+    }
+    co_await channel.async_send(boost::system::error_code{}, std::move(frame), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+}
+
+}    // namespace leaf
+
+#endif
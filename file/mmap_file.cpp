@@ -0,0 +1,78 @@
+#include <filesystem>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include "file/mmap_file.h"
+
+namespace leaf
+{
+class mmap_file_impl
+{
+   public:
+    explicit mmap_file_impl(std::string filename) : filename_(std::move(filename)) {}
+
+    boost::system::error_code open()
+    {
+        boost::system::error_code ec;
+        auto file_size = std::filesystem::file_size(filename_, ec);
+        if (ec)
+        {
+            return ec;
+        }
+        size_ = file_size;
+        // 空文件无法映射
+        if (size_ == 0)
+        {
+            return ec;
+        }
+        try
+        {
+            mapping_ = boost::interprocess::file_mapping(filename_.c_str(), boost::interprocess::read_only);
+            region_ = boost::interprocess::mapped_region(mapping_, boost::interprocess::read_only, 0, size_);
+            region_.advise(boost::interprocess::mapped_region::advice_sequential);
+        }
+        catch (const boost::interprocess::interprocess_exception& e)
+        {
+            static constexpr boost::source_location loc = BOOST_CURRENT_LOCATION;
+            ec.assign(e.get_native_error(), boost::system::system_category(), &loc);
+        }
+        return ec;
+    }
+
+    boost::system::error_code close()
+    {
+        region_ = boost::interprocess::mapped_region();
+        mapping_ = boost::interprocess::file_mapping();
+        size_ = 0;
+        return {};
+    }
+
+    boost::asio::const_buffer slice(uint64_t offset, std::size_t size) const
+    {
+        if (offset >= size_)
+        {
+            return {};
+        }
+        auto len = std::min<uint64_t>(size, size_ - offset);
+        return {static_cast<const uint8_t*>(region_.get_address()) + offset, static_cast<std::size_t>(len)};
+    }
+
+    std::size_t size() const { return size_; }
+    std::string name() const { return filename_; }
+
+   private:
+    std::size_t size_ = 0;
+    std::string filename_;
+    boost::interprocess::file_mapping mapping_;
+    boost::interprocess::mapped_region region_;
+};
+
+mmap_file_reader::mmap_file_reader(std::string filename) : impl_(new mmap_file_impl(std::move(filename))) {}
+mmap_file_reader::~mmap_file_reader() { delete impl_; }
+boost::system::error_code mmap_file_reader::open() { return impl_->open(); }
+boost::system::error_code mmap_file_reader::close() { return impl_->close(); }
+boost::asio::const_buffer mmap_file_reader::slice(uint64_t offset, std::size_t size) const { return impl_->slice(offset, size); }
+std::size_t mmap_file_reader::size() const { return impl_->size(); }
+std::string mmap_file_reader::name() const { return impl_->name(); }
+
+}    // namespace leaf
@@ -0,0 +1,34 @@
+#ifndef LEAF_FILE_MMAP_FILE_H
+#define LEAF_FILE_MMAP_FILE_H
+
+#include <string>
+#include <boost/asio/buffer.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace leaf
+{
+// 只读文件映射, slice 返回映射区内的视图, 不拷贝数据
+// 视图在 mmap_file_reader 销毁或 close 之前有效
+class mmap_file_impl;
+class mmap_file_reader
+{
+   public:
+    explicit mmap_file_reader(std::string filename);
+    ~mmap_file_reader();
+    mmap_file_reader(const mmap_file_reader&) = delete;
+    mmap_file_reader& operator=(const mmap_file_reader&) = delete;
+
+   public:
+    [[nodiscard]] std::string name() const;
+    boost::system::error_code open();
+    boost::system::error_code close();
+    [[nodiscard]] boost::asio::const_buffer slice(uint64_t offset, std::size_t size) const;
+    [[nodiscard]] std::size_t size() const;
+
+   private:
+    mmap_file_impl* impl_ = nullptr;
+};
+
+}    // namespace leaf
+
+#endif
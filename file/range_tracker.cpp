@@ -0,0 +1,77 @@
+#include "file/range_tracker.h"
+
+namespace leaf
+{
+static bool overlap(const std::map<uint64_t, uint64_t> &ranges, uint64_t offset, uint64_t length)
+{
+    for (const auto &[begin, size] : ranges)
+    {
+        if (begin < offset + length && offset < begin + size)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool range_tracker::begin(const std::string &path, uint64_t file_size, uint64_t offset, uint64_t length, bool &first)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    first = !files_.contains(path);
+    auto &f = files_[path];
+    if (first)
+    {
+        f.file_size = file_size;
+    }
+    if (f.file_size != file_size || overlap(f.active, offset, length) || overlap(f.done, offset, length))
+    {
+        if (first)
+        {
+            files_.erase(path);
+        }
+        return false;
+    }
+    f.active.emplace(offset, length);
+    return true;
+}
+
+bool range_tracker::complete(const std::string &path, uint64_t offset, uint64_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    if (it == files_.end())
+    {
+        return false;
+    }
+    auto &f = it->second;
+    if (f.active.erase(offset) == 0)
+    {
+        return false;
+    }
+    f.done.emplace(offset, length);
+    f.done_size += length;
+    // 范围之间没有重叠, 总长度等于文件大小即全部完成
+    if (f.done_size != f.file_size)
+    {
+        return false;
+    }
+    files_.erase(it);
+    return true;
+}
+
+void range_tracker::abort(const std::string &path, uint64_t offset, uint64_t /*length*/)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(path);
+    if (it == files_.end())
+    {
+        return;
+    }
+    it->second.active.erase(offset);
+    if (it->second.active.empty() && it->second.done.empty())
+    {
+        files_.erase(it);
+    }
+}
+
+}    // namespace leaf
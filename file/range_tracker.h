@@ -0,0 +1,43 @@
+#ifndef LEAF_FILE_RANGE_TRACKER_H
+#define LEAF_FILE_RANGE_TRACKER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "util/singleton.h"
+
+namespace leaf
+{
+// 多个连接分段上传同一个文件时, 记录每个 .tmp 文件正在上传和已经完成的范围
+// 所有范围都完成后才能改名为 .leaf
+class range_tracker
+{
+    struct file_ranges
+    {
+        uint64_t file_size = 0;
+        uint64_t done_size = 0;
+        std::map<uint64_t, uint64_t> active;    // offset -> length
+        std::map<uint64_t, uint64_t> done;      // offset -> length
+    };
+
+   public:
+    // 申请一个范围, 与已有范围重叠或文件大小不一致时返回 false
+    // first 表示这是文件的第一个范围, 调用者需要检查 .tmp 是否残留
+    bool begin(const std::string &path, uint64_t file_size, uint64_t offset, uint64_t length, bool &first);
+    // 范围写入并校验完成, 整个文件都完成时返回 true 并清除记录
+    bool complete(const std::string &path, uint64_t offset, uint64_t length);
+    // 范围上传失败, 释放申请, 客户端可以重新上传这个范围
+    void abort(const std::string &path, uint64_t offset, uint64_t length);
+
+   private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, file_ranges> files_;
+};
+
+using upload_ranges = singleton<range_tracker>;
+
+}    // namespace leaf
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef LEAF_FILE_TRANSFER_QUEUE_H
+#define LEAF_FILE_TRANSFER_QUEUE_H
+
+#include <map>
+#include <utility>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <cstdint>
+#include "config/config.h"
+
+namespace leaf
+{
+enum class transfer_priority : uint8_t
+{
+    interactive = 0,    // 用户正在等待的文件
+    bulk = 1,           // 备份等后台传输
+};
+
+// 客户端待传输文件的队列, 只在 session 的 io 线程上使用
+// interactive 先于 bulk, 同一类按加入顺序, 打开 smallest_first 后小文件优先, 大小未知的排在最后
+// bulk 任务等待超过 kTransferAging 后提升到 interactive, 在 interactive 中按原来的顺序排列, 避免饿死
+// 每一类是一个有序表, 取任务和提升都是 O(log n)
+// Task 需要 filename, size 和 priority 字段
+template <typename Task>
+class transfer_queue
+{
+    using clock = std::chrono::steady_clock;
+    // 大小 (没有打开 smallest_first 时为 0), 加入顺序
+    using key = std::pair<uint64_t, uint64_t>;
+    struct entry
+    {
+        Task task;
+        clock::time_point enqueued;
+    };
+    using entries = std::map<key, entry>;
+
+   public:
+    void push(Task task)
+    {
+        auto k = key{size_key(task), seq_++};
+        auto& cls = entries_of(task.priority);
+        cls.emplace(k, entry{std::move(task), clock::now()});
+        if (&cls == &bulk_)
+        {
+            aging_.emplace(k.second, k);
+        }
+    }
+    [[nodiscard]] bool empty() const { return interactive_.empty() && bulk_.empty(); }
+    [[nodiscard]] std::size_t size() const { return interactive_.size() + bulk_.size(); }
+    [[nodiscard]] const Task& front()
+    {
+        promote();
+        return interactive_.empty() ? bulk_.begin()->second.task : interactive_.begin()->second.task;
+    }
+    Task pop()
+    {
+        promote();
+        auto& cls = interactive_.empty() ? bulk_ : interactive_;
+        auto node = cls.extract(cls.begin());
+        if (&cls == &bulk_)
+        {
+            aging_.erase(node.key().second);
+        }
+        return std::move(node.mapped().task);
+    }
+    // 修改排队中的任务, 返回修改的数量
+    std::size_t set_priority(const std::string& filename, transfer_priority priority)
+    {
+        std::size_t count = 0;
+        auto& target = entries_of(priority);
+        auto& source = &target == &bulk_ ? interactive_ : bulk_;
+        for (auto& [k, e] : target)
+        {
+            if (e.task.filename == filename)
+            {
+                e.task.priority = priority;
+                count++;
+            }
+        }
+        // 先统计已经在目标类中的任务, 再移动另一类中的, 移过去的任务不会被再次计数
+        for (auto it = source.begin(); it != source.end();)
+        {
+            if (it->second.task.filename != filename)
+            {
+                ++it;
+                continue;
+            }
+            it->second.task.priority = priority;
+            count++;
+            auto node = source.extract(it++);
+            move_node(std::move(node), source, target);
+        }
+        return count;
+    }
+    void set_smallest_first(bool enable)
+    {
+        if (smallest_first_ == enable)
+        {
+            return;
+        }
+        smallest_first_ = enable;
+        // 排序依据变化, 重新建立两个有序表
+        aging_.clear();
+        for (auto* cls : {&interactive_, &bulk_})
+        {
+            entries rebuilt;
+            for (auto& [k, e] : *cls)
+            {
+                auto nk = key{size_key(e.task), k.second};
+                if (cls == &bulk_)
+                {
+                    aging_.emplace(nk.second, nk);
+                }
+                rebuilt.emplace(nk, std::move(e));
+            }
+            cls->swap(rebuilt);
+        }
+    }
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (const auto* cls : {&interactive_, &bulk_})
+        {
+            for (const auto& [k, e] : *cls)
+            {
+                f(e.task);
+            }
+        }
+    }
+
+   private:
+    [[nodiscard]] uint64_t size_key(const Task& task) const
+    {
+        if (!smallest_first_)
+        {
+            return 0;
+        }
+        return task.size == 0 ? std::numeric_limits<uint64_t>::max() : task.size;
+    }
+    entries& entries_of(transfer_priority priority) { return priority == transfer_priority::interactive ? interactive_ : bulk_; }
+    void move_node(typename entries::node_type node, const entries& from, entries& to)
+    {
+        if (&from == &bulk_)
+        {
+            aging_.erase(node.key().second);
+        }
+        if (&to == &bulk_)
+        {
+            aging_.emplace(node.key().second, node.key());
+        }
+        to.insert(std::move(node));
+    }
+    // 按加入顺序检查最早的 bulk 任务, 超时的移到 interactive
+    void promote()
+    {
+        auto now = clock::now();
+        while (!aging_.empty())
+        {
+            auto it = bulk_.find(aging_.begin()->second);
+            if (now - it->second.enqueued < kTransferAging)
+            {
+                break;
+            }
+            move_node(bulk_.extract(it), bulk_, interactive_);
+        }
+    }
+
+   private:
+    bool smallest_first_ = false;
+    uint64_t seq_ = 0;
+    entries interactive_;
+    entries bulk_;
+    std::map<uint64_t, key> aging_;    // bulk 任务的加入顺序 -> key
+};
+
+}    // namespace leaf
+
+#endif
@@ -5,6 +5,13 @@
 #include "config/config.h"
 #include "protocol/codec.h"
 #include "protocol/message.h"
+#include "file/async_file.h"
+#include "file/disk_executors.h"
+#include "file/checkpoint.h"
+#include "file/delta.h"
+#include "file/content_index.h"
+#include "file/range_tracker.h"
+#include "file/memory_governor.h"
 #include "file/upload_file_handle.h"
 
 namespace leaf
@@ -34,13 +41,13 @@ boost::asio::awaitable<void> upload_file_handle ::write_coro()
     while (true)
     {
         boost::system::error_code ec;
-        auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
             LOG_ERROR("{} write coro error {}", id_, ec.message());
             co_return;
         }
-        co_await session_->write(ec, bytes.data(), bytes.size());
+        co_await session_->write(ec, frame.buffers());
         if (ec)
         {
             LOG_ERROR("{} write_:oro error {}", id_, ec.message());
@@ -76,41 +83,75 @@ boost::asio::awaitable<void> upload_file_handle::recv_coro()
         LOG_ERROR("{} login error {}", id_, ec.message());
         co_return;
     }
+    // 按消息类型和 stream 分发, 多路复用时多个文件的消息交错到达
     boost::beast::flat_buffer buffer;
     while (true)
     {
-        co_await on_keepalive(ec);
+        buffer.consume(buffer.size());
+        co_await session_->read(ec, buffer);
         if (ec)
         {
-            LOG_ERROR("{} keepalive error {}", id_, ec.message());
+            LOG_ERROR("{} recv coro error {}", id_, ec.message());
             break;
         }
-        continue;
-
-        // setup 2 wait upload file request
-        auto ctx = co_await wait_upload_file_request(ec);
-        if (ec)
+        auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
+        auto type = leaf::get_message_type(message);
+        auto stream = leaf::get_message_stream(message);
+        if (type == leaf::message_type::keepalive)
         {
-            LOG_ERROR("{} upload file request error {}", id_, ec.message());
-            co_return;
+            co_await on_keepalive(message, ec);
         }
-
-        // setup 3 wait ack
-        co_await wait_ack(ec);
-        if (ec)
+        else if (type == leaf::message_type::upload_file_request)
         {
-            LOG_ERROR("{} ack error {}", id_, ec.message());
-            co_return;
+            co_await on_upload_file_request(stream, message, ec);
+        }
+        else if (type == leaf::message_type::ack)
+        {
+            // 旧版本客户端在数据之前发送 ack
+            continue;
+        }
+        else if (type == leaf::message_type::bundle_request)
+        {
+            co_await on_bundle_request(stream, message, ec);
+        }
+        else if (type == leaf::message_type::file_data && bundles_.contains(stream))
+        {
+            co_await on_bundle_data(stream, message, ec);
+        }
+        else if (type == leaf::message_type::file_data)
+        {
+            co_await on_file_data(stream, message, ec);
+        }
+        else if (type == leaf::message_type::delta_copy)
+        {
+            co_await on_delta_copy(stream, message, ec);
+        }
+        else if (type == leaf::message_type::done && bundles_.contains(stream))
+        {
+            co_await on_bundle_done(stream, ec);
+        }
+        else if (type == leaf::message_type::done)
+        {
+            co_await on_file_done(stream, ec);
+        }
+        else
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         }
-
-        // setup 4 wait file data
-        co_await wait_file_data(ctx, ec);
         if (ec)
         {
-            LOG_ERROR("{} file data error {}", id_, ec.message());
-            co_return;
+            LOG_ERROR("{} recv coro message {} stream {} error {}", id_, static_cast<int>(type), stream, ec.message());
+            break;
         }
     }
+    while (!streams_.empty())
+    {
+        co_await close_stream(streams_.begin()->first);
+    }
+    while (!bundles_.empty())
+    {
+        co_await close_bundle(bundles_.begin()->first);
+    }
 }
 
 boost::asio::awaitable<void> upload_file_handle::wait_login(boost::beast::error_code& ec)
@@ -121,215 +162,727 @@ boost::asio::awaitable<void> upload_file_handle::wait_login(boost::beast::error_
         LOG_ERROR("{} handshake error {}", id_, ec.message());
         co_return;
     }
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
+    auto login = co_await leaf::read_login(*session_, leaf::local_hello(), options_, nullptr, ec);
     if (ec)
     {
-        LOG_ERROR("{} recv coro error {}", id_, ec.message());
+        LOG_ERROR("{} login error {}", id_, ec.message());
         co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    auto bytes = std::vector<uint8_t>(message.begin(), message.end());
-    if (type != leaf::message_type::login)
+
+    token_ = login->token.token;
+    // 同一个 token 的连接共享分组限速
+    session_->join_rate_group(token_);
+    LOG_INFO("{} login success token {} version {} capabilities {} block size {} window {}",
+             id_,
+             token_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::login_reply(login.value(), options_)), ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::on_upload_file_request(uint32_t stream,
+                                                                       std::span<const uint8_t> message,
+                                                                       boost::beast::error_code& ec)
+{
+    auto req = leaf::deserialize_upload_file_request(std::vector<uint8_t>(message.begin(), message.end()));
+    if (!req.has_value())
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         co_return;
     }
-    auto login = leaf::deserialize_login_token(bytes);
-    if (!login.has_value())
+    if (streams_.contains(stream) || bundles_.contains(stream))
     {
+        LOG_ERROR("{} upload_file request stream {} already exist", id_, stream);
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         co_return;
     }
+    // 单个文件的错误通过 error_message 通知客户端, 不影响连接上的其他文件
+    boost::beast::error_code file_ec;
+    auto upload_file_path = co_await leaf::dio::instance().run(leaf::make_file_path(token_),
+                                                               [this, &req]()
+                                                               {
+                                                                   // 文件名越出用户目录时 make_file_path 返回空
+                                                                   auto path = leaf::make_file_path(token_, req->filename);
+                                                                   return path.empty() ? path : leaf::encode_tmp_filename(path);
+                                                               });
+    // 分段上传时同一个 .tmp 由多个连接共同写入, 整个文件上传时占用全部范围
+    bool ranged = req->length != 0;
+    bool claimed = false;
+    bool first = true;
+    uint64_t end = ranged ? req->offset + req->length : req->filesize;
+    if (upload_file_path.empty() || (ranged && (!options_.has(leaf::kCapStripedUpload) || end < req->offset || end > req->filesize)))
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+    }
+    else if (!leaf::upload_ranges::instance().begin(upload_file_path, req->filesize, req->offset, end - req->offset, first))
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::device_or_resource_busy);
+    }
+    else
+    {
+        claimed = true;
+    }
+    // 断点续传只用于整个文件的上传
+    bool resumable = !ranged && options_.has(leaf::kCapResumeUpload);
+    uint64_t offset = req->offset;
+    uint32_t delta_block_size = 0;
+    std::vector<leaf::delta_block> signature;
+    std::shared_ptr<leaf::mmap_file_reader> basis;
+    bool deduplicated = false;
+    if (!file_ec && first)
+    {
+        bool exist = co_await leaf::dio::instance().run(upload_file_path,
+                                                        [&]()
+                                                        {
+                                                            bool e = std::filesystem::exists(upload_file_path, file_ec);
+                                                            // 与内容对象共享 inode 的 .tmp 不能原地续写, 删除后重新上传
+                                                            if (e && !file_ec && std::filesystem::hard_link_count(upload_file_path, file_ec) > 1)
+                                                            {
+                                                                e = !leaf::remove(upload_file_path);
+                                                            }
+                                                            return e;
+                                                        });
+        // 已有相同内容时直接链接到最终的文件, 不需要传输数据
+        if (!file_ec && !exist && !ranged && !req->hash.empty() && options_.has(leaf::kCapDedupUpload))
+        {
+            boost::system::error_code link_ec;
+            deduplicated = co_await leaf::dio::instance().run(upload_file_path,
+                                                              [&]()
+                                                              {
+                                                                  auto leaf_file = leaf::make_file_path(token_, req->filename);
+                                                                  leaf_file = leaf::encode_leaf_filename(leaf_file);
+                                                                  return leaf::link_content(token_, req->hash, req->filesize, leaf_file, link_ec);
+                                                              });
+            if (link_ec)
+            {
+                LOG_ERROR("{} upload_file {} link content error {}", id_, upload_file_path, link_ec.message());
+            }
+        }
+        // 没有未完成的上传时, 服务端已有的同名文件作为增量上传的基准
+        if (!file_ec && !exist && !deduplicated && !ranged && req->delta && options_.has(leaf::kCapDeltaUpload))
+        {
+            basis = co_await open_basis(req->filename, delta_block_size, signature);
+        }
+        if (!file_ec && exist && ranged)
+        {
+            // 没有范围记录时残留的 .tmp 来自中断的分段上传 (连接全部断开或服务重启)
+            // 所有范围都会重新写入, 只截断超出文件大小的部分, 其他连接可能已经开始写入, 不能删除
+            co_await leaf::dio::instance().run(upload_file_path,
+                                               [&]()
+                                               {
+                                                   std::filesystem::resize_file(upload_file_path, req->filesize, file_ec);
+                                                   leaf::remove_checkpoint(upload_file_path);
+                                               });
+        }
+        else if (!file_ec && exist && !resumable)
+        {
+            file_ec = boost::system::errc::make_error_code(boost::system::errc::file_exists);
+        }
+        else if (!file_ec && exist)
+        {
+            offset = co_await leaf::dio::instance().run(upload_file_path,
+                                                        [&]() { return leaf::restore_checkpoint(upload_file_path, req->filesize, file_ec); });
+        }
+        else if (!file_ec && resumable && basis == nullptr && !deduplicated)
+        {
+            file_ec =
+                co_await leaf::dio::instance().run(upload_file_path, [&]() { return leaf::create_checkpoint(upload_file_path, req->filesize); });
+        }
+    }
+    if (file_ec)
+    {
+        if (claimed)
+        {
+            leaf::upload_ranges::instance().abort(upload_file_path, req->offset, end - req->offset);
+        }
+        LOG_ERROR("{} upload_file request stream {} file {} error {}", id_, stream, upload_file_path, file_ec.message());
+        co_await error_message(stream, req->id, file_ec.value());
+        co_return;
+    }
+    if (deduplicated)
+    {
+        co_await on_deduplicated(stream, req.value(), upload_file_path, ec);
+        co_return;
+    }
+    LOG_INFO("{} upload_file request stream {} file size {} range {} {} resume {} delta blocks {} name {} path {}",
+             id_,
+             stream,
+             req->filesize,
+             req->offset,
+             req->length,
+             offset,
+             signature.size(),
+             req->filename,
+             upload_file_path);
+
+    upload_context ctx;
+    ctx.stream = stream;
+    ctx.offset = offset;
+    ctx.end = end;
+    // 增量上传的数据不是连续的窗口, 不记录断点
+    ctx.resumable = resumable && basis == nullptr;
+    ctx.delta_block_size = delta_block_size;
+    ctx.basis = basis;
+    ctx.file = std::make_shared<file_info>();
+    ctx.file->file_path = upload_file_path;
+    ctx.file->filename = req->filename;
+    ctx.file->file_size = req->filesize;
+    ctx.file->hash_count = 0;
+    ctx.request = req.value();
+    ctx.hash = std::make_shared<leaf::blake2b>();
+    ctx.writer = std::make_shared<leaf::async_file_writer>(io_, upload_file_path);
+    file_ec = ctx.writer->open();
+    if (file_ec)
+    {
+        leaf::upload_ranges::instance().abort(upload_file_path, req->offset, end - req->offset);
+        LOG_ERROR("{} upload_file open file {} error {}", id_, upload_file_path, file_ec.message());
+        co_await error_message(stream, req->id, file_ec.value());
+        co_return;
+    }
+    streams_.emplace(stream, std::move(ctx));
 
-    token_ = login->token;
-    LOG_INFO("{} login success token {}", id_, token_);
-    co_await channel_.async_send(ec, leaf::serialize_login_token(login.value()), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    leaf::upload_file_response ufr;
+    ufr.id = req->id;
+    ufr.filename = req->filename;
+    ufr.offset = offset;
+    ufr.delta_block_size = delta_block_size;
+    ufr.signature = std::move(signature);
+    auto bytes = leaf::serialize_upload_file_response(ufr, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
-boost::asio::awaitable<leaf::upload_file_handle::upload_context> upload_file_handle::wait_upload_file_request(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_file_handle::on_file_data(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec)
 {
-    leaf::upload_file_handle::upload_context ctx;
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
-    if (ec)
+    auto d = leaf::deserialize_file_data_view(message);
+    if (!d.has_value() || d->data.size() > options_.max_block_size)
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    auto it = streams_.find(stream);
+    if (it == streams_.end())
     {
-        LOG_ERROR("{} upload file request error {}", id_, ec.message());
-        co_return ctx;
+        // 出错的 stream 已经关闭, 丢弃还在路上的数据
+        LOG_DEBUG("{} upload file data stream {} not found", id_, stream);
+        co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    buffer.consume(buffer.size());
-    auto type = leaf::get_message_type(message);
-    if (type != leaf::message_type::upload_file_request)
+    auto& ctx = it->second;
+    boost::beast::error_code file_ec;
+    // 数据不能越过本次上传的范围
+    auto offset = ctx.offset + ctx.writer->size();
+    if (offset + d->data.size() > ctx.end)
     {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return ctx;
+        LOG_ERROR("{} upload file {} stream {} data exceeds range", id_, ctx.file->filename, stream);
+        co_await error_message(stream, ctx.request.id, boost::system::errc::file_too_large);
+        co_await close_stream(stream);
+        co_return;
     }
-    auto bytes = std::vector<uint8_t>(message.begin(), message.end());
-    auto req = leaf::deserialize_upload_file_request(bytes);
-    if (!req.has_value())
+    co_await ctx.writer->write_at(static_cast<int64_t>(offset), d->data.data(), d->data.size(), file_ec);
+    if (file_ec)
     {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return ctx;
+        LOG_ERROR("{} upload file write error {} {}", id_, ctx.file->filename, file_ec.message());
+        co_await error_message(stream, ctx.request.id, file_ec.value());
+        co_await close_stream(stream);
+        co_return;
     }
+    ctx.file->hash_count++;
+    ctx.hash->update(d->data.data(), d->data.size());
+
+    LOG_DEBUG("{} upload file {} stream {} hash count {} hash {} data size {} write size {}",
+              id_,
+              ctx.file->filename,
+              stream,
+              ctx.file->hash_count,
+              d->hash.empty() ? "empty" : d->hash,
+              d->data.size(),
+              ctx.writer->size());
 
-    auto upload_file_path = leaf::encode_tmp_filename(leaf::make_file_path(token_, req->filename));
-    bool exist = std::filesystem::exists(upload_file_path, ec);
+    if (!d->hash.empty())
+    {
+        ctx.hash->final();
+        auto hex_str = ctx.hash->hex();
+        if (hex_str != d->hash)
+        {
+            LOG_ERROR("{} upload file hash not match {} {} {}", id_, ctx.file->filename, hex_str, d->hash);
+            co_await error_message(stream, ctx.request.id, boost::system::errc::illegal_byte_sequence);
+            co_await close_stream(stream);
+            co_return;
+        }
+        ctx.file->hash_count = 0;
+        ctx.hash = std::make_shared<leaf::blake2b>();
+        // 窗口校验通过后记录断点, 中断后从这里继续
+        if (ctx.resumable)
+        {
+            auto end = ctx.offset + ctx.writer->size();
+            file_ec = co_await leaf::dio::instance().run(ctx.file->file_path,
+                                                         [&]() { return leaf::append_checkpoint(ctx.file->file_path, end, hex_str); });
+            if (file_ec)
+            {
+                LOG_ERROR("{} upload file {} checkpoint error {}", id_, ctx.file->filename, file_ec.message());
+            }
+        }
+    }
+    co_await grant_credit(stream, ctx.credits, ec);
+}
+
+boost::asio::awaitable<std::shared_ptr<leaf::mmap_file_reader>> upload_file_handle::open_basis(const std::string& filename,
+                                                                                               uint32_t& block_size,
+                                                                                               std::vector<leaf::delta_block>& signature)
+{
+    // 基准文件不可用时退回完整上传, 不作为错误
+    boost::system::error_code ec;
+    auto leaf_file_path = co_await leaf::dio::instance().run(
+        leaf::make_file_path(token_), [this, &filename]() { return leaf::encode_leaf_filename(leaf::make_file_path(token_, filename)); });
+    auto basis = co_await leaf::dio::instance().run(
+        leaf_file_path,
+        [&]() -> std::shared_ptr<leaf::mmap_file_reader>
+        {
+            if (!std::filesystem::exists(leaf_file_path, ec) || ec)
+            {
+                return nullptr;
+            }
+            auto reader = std::make_shared<leaf::mmap_file_reader>(leaf_file_path);
+            ec = reader->open();
+            if (ec)
+            {
+                return nullptr;
+            }
+            block_size = leaf::delta_block_size(reader->size(), options_.block_size);
+            signature = leaf::make_signature(*reader, block_size);
+            return reader;
+        });
     if (ec)
     {
-        LOG_ERROR("{} upload_file request file {} exist failed {}", id_, upload_file_path, ec.message());
-        co_return ctx;
+        LOG_ERROR("{} upload file {} open basis {} error {}", id_, filename, leaf_file_path, ec.message());
     }
-    if (exist)
+    if (basis == nullptr || signature.empty())
     {
-        LOG_ERROR("{} upload_file request file {} exist", id_, upload_file_path);
-        ec = boost::system::errc::make_error_code(boost::system::errc::file_exists);
-        co_return ctx;
+        block_size = 0;
+        signature.clear();
+        co_return nullptr;
     }
-    LOG_INFO("{} upload_file request file size {} name {} path {}", id_, req->filesize, req->filename, upload_file_path);
+    LOG_INFO("{} upload file {} basis {} size {} block size {}", id_, filename, leaf_file_path, basis->size(), block_size);
+    co_return basis;
+}
+
+boost::asio::awaitable<void> upload_file_handle::on_delta_copy(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec)
+{
+    auto c = leaf::deserialize_delta_copy(std::vector<uint8_t>(message.begin(), message.end()));
+    if (!c.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    auto it = streams_.find(stream);
+    if (it == streams_.end())
+    {
+        LOG_DEBUG("{} upload delta copy stream {} not found", id_, stream);
+        co_return;
+    }
+    auto& ctx = it->second;
+    // 引用的块必须在基准文件内, 复制后不能越过本次上传的范围
+    const uint64_t blocks = ctx.basis ? ctx.basis->size() / ctx.delta_block_size : 0;
+    const uint64_t size = static_cast<uint64_t>(c->count) * ctx.delta_block_size;
+    const uint64_t offset = ctx.offset + ctx.writer->size();
+    if (c->count == 0 || c->index >= blocks || c->count > blocks - c->index || offset + size > ctx.end)
+    {
+        LOG_ERROR("{} upload file {} stream {} invalid delta copy {} {}", id_, ctx.file->filename, stream, c->index, c->count);
+        co_await error_message(stream, ctx.request.id, boost::system::errc::invalid_argument);
+        co_await close_stream(stream);
+        co_return;
+    }
+    // 基准文件是只读映射, 按块直接写入 .tmp
+    boost::beast::error_code file_ec;
+    const uint64_t source = c->index * ctx.delta_block_size;
+    for (uint64_t copied = 0; copied < size;)
+    {
+        auto block = ctx.basis->slice(source + copied, options_.block_size);
+        co_await ctx.writer->write_at(static_cast<int64_t>(offset + copied), block.data(), block.size(), file_ec);
+        if (file_ec)
+        {
+            LOG_ERROR("{} upload file delta copy error {} {}", id_, ctx.file->filename, file_ec.message());
+            co_await error_message(stream, ctx.request.id, file_ec.value());
+            co_await close_stream(stream);
+            co_return;
+        }
+        copied += block.size();
+    }
+    LOG_DEBUG("{} upload file {} stream {} delta copy {} {} write size {}", id_, ctx.file->filename, stream, c->index, c->count, ctx.writer->size());
+    co_await grant_credit(stream, ctx.credits, ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::on_deduplicated(uint32_t stream,
+                                                                 const leaf::upload_file_request& req,
+                                                                 const std::string& upload_file_path,
+                                                                 boost::beast::error_code& ec)
+{
+    // link_content 已经链接到最终的文件, 不需要改名
+    LOG_INFO("{} upload_file request stream {} file {} size {} deduplicated", id_, stream, req.filename, req.filesize);
+    leaf::upload_ranges::instance().complete(upload_file_path, 0, req.filesize);
 
-    auto file = std::make_shared<file_info>();
-    file->file_path = upload_file_path;
-    file->filename = req->filename;
-    file->file_size = req->filesize;
-    file->hash_count = 0;
-    ctx.file = file;
-    ctx.request = req.value();
     leaf::upload_file_response ufr;
-    ufr.id = req->id;
-    ufr.filename = req->filename;
-    co_await channel_.async_send(ec, leaf::serialize_upload_file_response(ufr), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-    co_return ctx;
+    ufr.id = req.id;
+    ufr.filename = req.filename;
+    ufr.offset = req.filesize;
+    ufr.deduplicated = true;
+    auto bytes = leaf::serialize_upload_file_response(ufr, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
-boost::asio::awaitable<void> upload_file_handle::wait_ack(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_file_handle::on_file_done(uint32_t stream, boost::beast::error_code& ec)
 {
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
-    if (ec)
+    auto it = streams_.find(stream);
+    if (it == streams_.end())
     {
-        LOG_ERROR("{} recv_coro error {}", id_, ec.message());
         co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    buffer.consume(buffer.size());
-    auto type = leaf::get_message_type(message);
-    if (type != leaf::message_type::ack)
+    auto ctx = std::move(it->second);
+    streams_.erase(it);
+    auto close_ec = ctx.writer->close();
+    if (close_ec || ctx.offset + ctx.writer->size() != ctx.end)
     {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        LOG_ERROR("{} upload file {} end {} write end {} close {}",
+                  id_,
+                  ctx.file->filename,
+                  ctx.end,
+                  ctx.offset + ctx.writer->size(),
+                  close_ec.message());
+        leaf::upload_ranges::instance().abort(ctx.file->file_path, ctx.request.offset, ctx.end - ctx.request.offset);
+        co_await error_message(stream, ctx.request.id, boost::system::errc::io_error);
         co_return;
     }
+    // 分段上传时只有最后完成的范围负责改名
+    if (leaf::upload_ranges::instance().complete(ctx.file->file_path, ctx.request.offset, ctx.end - ctx.request.offset))
+    {
+        co_await rename_leaf(ctx);
+    }
+    else
+    {
+        LOG_INFO("{} upload file {} range {} {} done", id_, ctx.file->file_path, ctx.request.offset, ctx.request.length);
+    }
+    // 旧版本客户端不等待 done 的回复
+    if (options_.has(leaf::kCapMultiplex))
+    {
+        auto bytes = leaf::serialize_done(leaf::done{});
+        leaf::set_message_stream(bytes, stream);
+        co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+    }
 }
 
-boost::asio::awaitable<void> upload_file_handle::wait_file_data(leaf::upload_file_handle::upload_context& ctx, boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_file_handle::on_bundle_request(uint32_t stream,
+                                                                  std::span<const uint8_t> message,
+                                                                  boost::beast::error_code& ec)
 {
-    auto hash = std::make_shared<leaf::blake2b>();
-    auto writer = std::make_shared<leaf::file_writer>(ctx.file->file_path);
-    ec = writer->open();
-    if (ec)
+    auto req = leaf::deserialize_bundle_request(std::vector<uint8_t>(message.begin(), message.end()));
+    if (!req.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    if (streams_.contains(stream) || bundles_.contains(stream))
+    {
+        LOG_ERROR("{} bundle request stream {} already exist", id_, stream);
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    boost::beast::error_code file_ec;
+    if (!options_.has(leaf::kCapBundleUpload) || req->files.empty() || req->files.size() > kBundleMaxFiles)
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+    }
+    // 在一次磁盘任务中解析所有路径并创建目录, 申请每个 .tmp
+    bundle_context ctx;
+    ctx.id = req->id;
+    ctx.files = std::move(req->files);
+    if (!file_ec)
+    {
+        ctx.paths = co_await leaf::dio::instance().run(
+            leaf::make_file_path(token_),
+            [this, &ctx, &file_ec]()
+            {
+                std::vector<std::string> paths;
+                for (const auto& file : ctx.files)
+                {
+                    auto path = leaf::make_file_path(token_, file.filename);
+                    bool first = true;
+                    if (path.empty())
+                    {
+                        file_ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+                    }
+                    else if (!leaf::upload_ranges::instance().begin(leaf::encode_tmp_filename(path), file.filesize, 0, file.filesize, first))
+                    {
+                        file_ec = boost::system::errc::make_error_code(boost::system::errc::device_or_resource_busy);
+                    }
+                    else
+                    {
+                        paths.push_back(leaf::encode_tmp_filename(path));
+                    }
+                    // 与单个文件上传相同, 残留的 .tmp 不覆盖
+                    if (!file_ec && (!first || std::filesystem::exists(paths.back(), file_ec)) && !file_ec)
+                    {
+                        file_ec = boost::system::errc::make_error_code(boost::system::errc::file_exists);
+                    }
+                    if (file_ec)
+                    {
+                        break;
+                    }
+                }
+                return paths;
+            });
+    }
+    if (file_ec)
     {
-        LOG_ERROR("{} upload_file open file {} error {}", id_, ctx.file->file_path, ec.message());
+        for (std::size_t i = 0; i < ctx.paths.size(); i++)
+        {
+            leaf::upload_ranges::instance().abort(ctx.paths[i], 0, ctx.files[i].filesize);
+        }
+        LOG_ERROR("{} bundle request stream {} files {} error {}", id_, stream, ctx.files.size(), file_ec.message());
+        co_await error_message(stream, req->id, file_ec.value());
         co_return;
     }
+    LOG_INFO("{} bundle request stream {} files {}", id_, stream, ctx.files.size());
+    bundles_.emplace(stream, std::move(ctx));
 
-    while (true)
+    leaf::upload_file_response ufr;
+    ufr.id = req->id;
+    auto bytes = leaf::serialize_upload_file_response(ufr, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::on_bundle_data(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec)
+{
+    auto d = leaf::deserialize_file_data_view(message);
+    if (!d.has_value() || d->data.size() > options_.max_block_size)
     {
-        boost::beast::flat_buffer buffer;
-        co_await session_->read(ec, buffer);
-        if (ec)
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+    }
+    auto& ctx = bundles_.at(stream);
+    // 每个消息单独校验, 文件的 hash 在文件写满时校验
+    leaf::blake2b frame_hash;
+    frame_hash.update(d->data.data(), static_cast<uint32_t>(d->data.size()));
+    frame_hash.final();
+    boost::beast::error_code file_ec;
+    if (frame_hash.hex() != d->hash)
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::illegal_byte_sequence);
+    }
+    auto data = d->data;
+    while (!file_ec && !data.empty())
+    {
+        co_await next_bundle_file(ctx, file_ec);
+        if (file_ec)
         {
-            LOG_ERROR("{} recv_coro error {}", id_, ec.message());
             break;
         }
-        auto message = boost::beast::buffers_to_string(buffer.data());
-        auto type = leaf::get_message_type(message);
-        if (type == leaf::message_type::done)
+        if (ctx.index == ctx.files.size())
         {
-            LOG_INFO("{} upload file {} done", id_, ctx.file->filename);
+            file_ec = boost::system::errc::make_error_code(boost::system::errc::file_too_large);
             break;
         }
-        if (type != leaf::message_type::file_data)
+        auto size = static_cast<std::size_t>(std::min<uint64_t>(data.size(), ctx.files[ctx.index].filesize - ctx.written));
+        co_await ctx.writer->write_at(static_cast<int64_t>(ctx.written), data.data(), size, file_ec);
+        ctx.hash->update(data.data(), static_cast<uint32_t>(size));
+        ctx.written += size;
+        data = data.subspan(size);
+    }
+    if (file_ec)
+    {
+        LOG_ERROR("{} bundle stream {} file {} error {}", id_, stream, ctx.index, file_ec.message());
+        co_await error_message(stream, ctx.id, file_ec.value());
+        co_await close_bundle(stream);
+        co_return;
+    }
+    co_await grant_credit(stream, ctx.credits, ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::grant_credit(uint32_t stream, uint32_t& credits, boost::beast::error_code& ec)
+{
+    if (!options_.has(leaf::kCapCreditFlow))
+    {
+        co_return;
+    }
+    // 数据写入文件后归还, 攒够窗口的四分之一再发送
+    credits++;
+    if (credits < std::max<uint32_t>(options_.window / 4, 1))
+    {
+        co_return;
+    }
+    auto bytes = leaf::serialize_credit(leaf::credit{credits}, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    credits = 0;
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::on_bundle_done(uint32_t stream, boost::beast::error_code& ec)
+{
+    auto& ctx = bundles_.at(stream);
+    // 结尾的空文件没有数据, 在这里创建
+    boost::beast::error_code file_ec;
+    co_await next_bundle_file(ctx, file_ec);
+    if (!file_ec && ctx.index != ctx.files.size())
+    {
+        file_ec = boost::system::errc::make_error_code(boost::system::errc::io_error);
+    }
+    if (file_ec)
+    {
+        LOG_ERROR("{} bundle stream {} done {} of {} error {}", id_, stream, ctx.index, ctx.files.size(), file_ec.message());
+        co_await error_message(stream, ctx.id, file_ec.value());
+        co_await close_bundle(stream);
+        co_return;
+    }
+    LOG_INFO("{} bundle stream {} files {} done", id_, stream, ctx.files.size());
+    bundles_.erase(stream);
+    auto bytes = leaf::serialize_done(leaf::done{});
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+}
+
+boost::asio::awaitable<void> upload_file_handle::next_bundle_file(leaf::upload_file_handle::bundle_context& ctx, boost::beast::error_code& ec)
+{
+    while (ctx.index < ctx.files.size())
+    {
+        if (ctx.writer == nullptr)
         {
-            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-            break;
+            ctx.writer = std::make_shared<leaf::async_file_writer>(io_, ctx.paths[ctx.index]);
+            ctx.hash = std::make_shared<leaf::blake2b>();
+            ctx.written = 0;
+            ec = ctx.writer->open();
+            if (ec)
+            {
+                co_return;
+            }
         }
-        auto bytes = std::vector<uint8_t>(message.begin(), message.end());
-        auto d = leaf::deserialize_file_data(bytes);
-        if (!d.has_value())
+        if (ctx.written < ctx.files[ctx.index].filesize)
         {
-            break;
+            co_return;
         }
-        assert(d->data.size() <= kBlockSize);
-        writer->write_at(static_cast<int64_t>(writer->size()), d->data.data(), d->data.size(), ec);
+        co_await finish_bundle_file(ctx, ec);
         if (ec)
         {
-            LOG_ERROR("{} upload file write error {} {}", id_, ctx.file->filename, ec.message());
-            break;
+            co_return;
         }
-        ctx.file->hash_count++;
-        hash->update(d->data.data(), d->data.size());
+    }
+}
 
-        LOG_DEBUG("{} upload file {} hash count {} hash {} data size {} write size {}",
-                  id_,
-                  ctx.file->filename,
-                  ctx.file->hash_count,
-                  d->hash.empty() ? "empty" : d->hash,
-                  d->data.size(),
-                  writer->size());
+boost::asio::awaitable<void> upload_file_handle::finish_bundle_file(leaf::upload_file_handle::bundle_context& ctx, boost::beast::error_code& ec)
+{
+    ec = ctx.writer->close();
+    ctx.writer.reset();
+    if (ec)
+    {
+        co_return;
+    }
+    ctx.hash->final();
+    const auto& file = ctx.files[ctx.index];
+    if (ctx.hash->hex() != file.hash)
+    {
+        LOG_ERROR("{} bundle file {} hash not match", id_, file.filename);
+        ec = boost::system::errc::make_error_code(boost::system::errc::illegal_byte_sequence);
+        co_return;
+    }
+    const auto& tmp = ctx.paths[ctx.index];
+    co_await leaf::dio::instance().run(tmp, [&tmp]() { leaf::rename(tmp, leaf::tmp_to_leaf_filename(tmp)); });
+    leaf::upload_ranges::instance().complete(tmp, 0, file.filesize);
+    LOG_DEBUG("{} bundle file {} size {} done", id_, tmp, file.filesize);
+    ctx.index++;
+}
 
-        if (!d->hash.empty())
+boost::asio::awaitable<void> upload_file_handle::close_bundle(uint32_t stream)
+{
+    auto it = bundles_.find(stream);
+    if (it == bundles_.end())
+    {
+        co_return;
+    }
+    auto ctx = std::move(it->second);
+    bundles_.erase(it);
+    if (ctx.writer)
+    {
+        auto ec = ctx.writer->close();
+        if (ec)
         {
-            hash->final();
-            auto hex_str = hash->hex();
-            if (hex_str != d->hash)
-            {
-                LOG_ERROR("{} upload file hash not match {} {} {}", id_, ctx.file->filename, hex_str, d->hash);
-                break;
-            }
-            ctx.file->hash_count = 0;
-            hash = std::make_shared<leaf::blake2b>();
+            LOG_ERROR("{} bundle close file {} error {}", id_, ctx.paths[ctx.index], ec.message());
         }
-        if (ctx.file->file_size == writer->size())
+    }
+    // 打包上传不续传, 未完成的文件删除后释放, 客户端可以单独重新上传
+    std::vector<std::string> unfinished(ctx.paths.begin() + static_cast<std::ptrdiff_t>(ctx.index), ctx.paths.end());
+    co_await leaf::dio::instance().run(leaf::make_file_path(token_),
+                                       [&unfinished]()
+                                       {
+                                           for (const auto& tmp : unfinished)
+                                           {
+                                               leaf::remove(tmp);
+                                           }
+                                       });
+    for (std::size_t i = ctx.index; i < ctx.files.size(); i++)
+    {
+        leaf::upload_ranges::instance().abort(ctx.paths[i], 0, ctx.files[i].filesize);
+    }
+}
+
+boost::asio::awaitable<void> upload_file_handle::rename_leaf(const leaf::upload_file_handle::upload_context& ctx)
+{
+    auto filename = co_await leaf::dio::instance().run(ctx.file->file_path,
+                                                       [this, &ctx]()
+                                                       {
+                                                           auto leaf_filename = leaf::encode_leaf_filename(leaf::make_file_path(token_, ctx.file->filename));
+                                                           leaf::rename(ctx.file->file_path, leaf_filename);
+                                                           return leaf_filename;
+                                                       });
+    if (ctx.resumable)
+    {
+        co_await leaf::dio::instance().run(ctx.file->file_path, [&ctx]() { leaf::remove_checkpoint(ctx.file->file_path); });
+    }
+    // 校验内容后加入索引, 之后相同内容的上传直接链接
+    if (!ctx.request.hash.empty() && options_.has(leaf::kCapDedupUpload))
+    {
+        boost::system::error_code index_ec;
+        co_await leaf::dio::instance().run(filename, [&]() { leaf::index_content(token_, filename, ctx.request.hash, index_ec); });
+        if (index_ec)
         {
-            auto filename = leaf::encode_leaf_filename(leaf::make_file_path(token_, ctx.file->filename));
-            leaf::rename(ctx.file->file_path, filename);
-            LOG_INFO("{} upload file {} to {} done", id_, ctx.file->file_path, filename);
+            LOG_ERROR("{} upload file {} index content error {}", id_, filename, index_ec.message());
         }
     }
-    ec = writer->close();
+    LOG_INFO("{} upload file {} to {} done", id_, ctx.file->file_path, filename);
+}
+
+boost::asio::awaitable<void> upload_file_handle::close_stream(uint32_t stream)
+{
+    auto it = streams_.find(stream);
+    if (it == streams_.end())
+    {
+        co_return;
+    }
+    auto ctx = std::move(it->second);
+    streams_.erase(it);
+    // 未完成的范围释放后可以重新上传
+    leaf::upload_ranges::instance().abort(ctx.file->file_path, ctx.request.offset, ctx.end - ctx.request.offset);
+    auto ec = ctx.writer->close();
     if (ec)
     {
         LOG_ERROR("{} upload file close file {} error {}", id_, ctx.file->file_path, ec.message());
     }
 }
 
-boost::asio::awaitable<void> upload_file_handle::error_message(uint32_t id, int32_t error_code)
+boost::asio::awaitable<void> upload_file_handle::error_message(uint32_t stream, uint32_t id, int32_t error_code)
 {
     boost::system::error_code ec;
     leaf::error_message e;
     e.id = id;
     e.error = error_code;
-    auto bytes = leaf::serialize_error_message(e);
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    auto bytes = leaf::serialize_error_message(e, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
-boost::asio::awaitable<void> upload_file_handle::on_keepalive(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_file_handle::on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec)
 {
-    boost::beast::flat_buffer buffer;
-    co_await session_->read(ec, buffer);
-    if (ec)
-    {
-        LOG_ERROR("{} recv_coro error {}", id_, ec.message());
-        co_return;
-    }
-    auto message = boost::beast::buffers_to_string(buffer.data());
-    auto type = leaf::get_message_type(message);
-    if (type != leaf::message_type::keepalive)
-    {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
-    }
     auto k = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
     if (!k.has_value())
     {
@@ -346,6 +899,6 @@ boost::asio::awaitable<void> upload_file_handle::on_keepalive(boost::beast::erro
               sk.server_timestamp,
               sk.client_timestamp,
               token_);
-    co_await channel_.async_send(ec, serialize_keepalive(sk), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(serialize_keepalive(sk, options_.codec)), ec);
 }
 }    // namespace leaf
@@ -1,12 +1,19 @@
 #ifndef LEAF_FILE_UPLOAD_FILE_HANDLE_H
 #define LEAF_FILE_UPLOAD_FILE_HANDLE_H
 
+#include <map>
+#include <span>
 #include <mutex>
 #include <boost/asio/experimental/channel.hpp>
 #include "file/file.h"
 #include "protocol/message.h"
+#include "protocol/capability.h"
 #include "crypt/blake2b.h"
+#include "file/async_file.h"
+#include "file/mmap_file.h"
 #include "file/file_context.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/websocket_handle.h"
 
 namespace leaf
@@ -16,8 +23,30 @@ class upload_file_handle : public websocket_handle
 {
     struct upload_context
     {
+        uint32_t stream = 0;
+        uint64_t offset = 0;          // 本次写入的起始位置, 续传时为断点位置
+        uint64_t end = 0;             // 本次写入的结束位置
+        bool resumable = false;       // 是否记录断点
+        uint32_t credits = 0;         // 已写入还没有归还的信用
+        uint32_t delta_block_size = 0;
+        // 增量上传时服务端已有的文件, delta_copy 从这里复制
+        std::shared_ptr<leaf::mmap_file_reader> basis;
         leaf::file_info::ptr file;
         leaf::upload_file_request request;
+        std::shared_ptr<leaf::blake2b> hash;
+        std::shared_ptr<leaf::async_file_writer> writer;
+    };
+    // 打包上传, 文件内容按清单顺序连续写入, 每个文件写满后改名
+    struct bundle_context
+    {
+        uint32_t id = 0;
+        std::vector<leaf::bundle_entry> files;
+        std::vector<std::string> paths;    // 每个文件的 .tmp
+        std::size_t index = 0;             // 正在写入的文件
+        uint64_t written = 0;              // 当前文件已写入的大小
+        uint32_t credits = 0;
+        std::shared_ptr<leaf::blake2b> hash;
+        std::shared_ptr<leaf::async_file_writer> writer;
     };
 
    public:
@@ -34,22 +63,44 @@ class upload_file_handle : public websocket_handle
     boost::asio::awaitable<void> write_coro();
     boost::asio::awaitable<void> shutdown_coro();
     boost::asio::awaitable<void> wait_login(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> on_keepalive(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> error_message(uint32_t id, int32_t error_code);
-
-    boost::asio::awaitable<leaf::upload_file_handle::upload_context> wait_upload_file_request(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> wait_ack(boost::beast::error_code& ec);
-    boost::asio::awaitable<void> wait_file_data(leaf::upload_file_handle::upload_context& ctx, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> error_message(uint32_t stream, uint32_t id, int32_t error_code);
+    boost::asio::awaitable<void> on_upload_file_request(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_file_data(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_delta_copy(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<std::shared_ptr<leaf::mmap_file_reader>> open_basis(const std::string& filename,
+                                                                               uint32_t& block_size,
+                                                                               std::vector<leaf::delta_block>& signature);
+    boost::asio::awaitable<void> on_file_done(uint32_t stream, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_bundle_request(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_bundle_data(uint32_t stream, std::span<const uint8_t> message, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> on_bundle_done(uint32_t stream, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> next_bundle_file(leaf::upload_file_handle::bundle_context& ctx, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> finish_bundle_file(leaf::upload_file_handle::bundle_context& ctx, boost::beast::error_code& ec);
+    boost::asio::awaitable<void> close_bundle(uint32_t stream);
+    boost::asio::awaitable<void> on_deduplicated(uint32_t stream,
+                                                 const leaf::upload_file_request& req,
+                                                 const std::string& upload_file_path,
+                                                 boost::beast::error_code& ec);
+    boost::asio::awaitable<void> rename_leaf(const leaf::upload_file_handle::upload_context& ctx);
+    boost::asio::awaitable<void> close_stream(uint32_t stream);
+    boost::asio::awaitable<void> grant_credit(uint32_t stream, uint32_t& credits, boost::beast::error_code& ec);
 
    private:
     std::string id_;
     std::string user_;
     std::string token_;
+    leaf::session_options options_;
     std::vector<uint8_t> key_;
     std::once_flag shutdown_flag_;
     leaf::websocket_session::ptr session_;
-    const boost::asio::any_io_executor& io_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    boost::asio::any_io_executor io_;
+    // 正在上传的文件, 旧版本客户端只有 stream 0
+    std::map<uint32_t, upload_context> streams_;
+    std::map<uint32_t, bundle_context> bundles_;
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 
 }    // namespace leaf
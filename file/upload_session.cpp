@@ -1,9 +1,16 @@
 #include <utility>
 #include <filesystem>
+#include <unordered_set>
 #include "log/log.h"
 #include "file/file.h"
+#include "file/async_file.h"
+#include "file/disk_executors.h"
+#include "file/mmap_file.h"
+#include "file/delta.h"
+#include "file/hash_file.h"
 #include "config/config.h"
 #include "protocol/codec.h"
+#include "file/memory_governor.h"
 #include "file/upload_session.h"
 
 namespace leaf
@@ -19,7 +26,8 @@ upload_session::~upload_session() = default;
 void upload_session::startup()
 {
     LOG_INFO("{} startup", id_);
-    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/upload", io_);
+    auto profile = leaf::socket_presets::instance().bulk();
+    ws_client_ = std::make_shared<leaf::plain_websocket_client>(id_, host_, port_, "/leaf/ws/upload", io_, profile);
 
     boost::asio::co_spawn(
         io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await upload_coro(); }, boost::asio::detached);
@@ -40,18 +48,45 @@ boost::asio::awaitable<void> upload_session::upload_coro()
     leaf::login_token lt;
     lt.id = 0x01;
     lt.token = token_;
-    auto bytes = leaf::serialize_login_token(lt);
-    co_await channel_.async_send(boost::system::error_code{}, bytes, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    leaf::fill_hello(lt);
+    // 协商之前使用 json, 旧版本服务端也能解析
+    auto bytes = leaf::serialize_login_token(lt, leaf::codec_format::json);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
     if (ec)
     {
         LOG_ERROR("{} upload coro send login token error {}", id_, ec.message());
         co_return;
     }
-    while (true)
+    co_await wait_login(lt, ec);
+    if (ec)
+    {
+        co_return;
+    }
+    if (options_.has(leaf::kCapMultiplex))
+    {
+        co_await multiplex_upload(ec);
+    }
+    else
+    {
+        co_await sequential_upload(ec);
+    }
+    LOG_INFO("{} upload coro shutdown", id_);
+}
+
+boost::asio::awaitable<void> upload_session::sequential_upload(boost::beast::error_code& ec)
+{
+    // 旧版本服务端, 每次只传输一个文件
+    while (!stopped_)
     {
-        auto file = padding_files_.front();
-        padding_files_.pop_front();
-        auto ctx = create_upload_context(file, ec);
+        if (padding_files_.empty())
+        {
+            wakeup_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            ec = {};
+            continue;
+        }
+        auto task = padding_files_.pop();
+        auto ctx = co_await leaf::dio::instance().run(task.filename, [&]() { return create_upload_context(task, ec); });
         if (ec)
         {
             LOG_ERROR("{} create upload context error {}", id_, ec.message());
@@ -72,7 +107,7 @@ boost::asio::awaitable<void> upload_session::upload_coro()
             break;
         }
         // wait upload file response
-        co_await wait_upload_file_response(ec);
+        co_await wait_upload_file_response(ctx, ec);
         if (ec)
         {
             LOG_ERROR("{} wait upload file response error {}", id_, ec.message());
@@ -92,7 +127,440 @@ boost::asio::awaitable<void> upload_session::upload_coro()
             LOG_ERROR("{} send file data error {}", id_, ec.message());
         }
     }
-    LOG_INFO("{} upload coro shutdown", id_);
+}
+
+boost::asio::awaitable<void> upload_session::multiplex_upload(boost::beast::error_code& ec)
+{
+    boost::asio::co_spawn(io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await recv_coro(); }, boost::asio::detached);
+    while (!stopped_)
+    {
+        // 最多 kTransferStreams 个文件同时传输
+        while (!padding_files_.empty() && streams_.size() < kTransferStreams)
+        {
+            auto tasks = take_tasks();
+            auto stream = ++stream_seq_;
+            auto replies = std::make_shared<reply_channel>(io_, 4);
+            streams_.emplace(stream, replies);
+            if (options_.has(leaf::kCapCreditFlow))
+            {
+                credits_.emplace(stream, std::make_shared<leaf::credit_window>(io_.get_executor(), options_.window));
+            }
+            boost::asio::co_spawn(
+                io_,
+                [this, self = shared_from_this(), stream, tasks, replies]() -> boost::asio::awaitable<void>
+                {
+                    boost::beast::error_code ec;
+                    if (tasks.size() == 1)
+                    {
+                        co_await upload_file(stream, tasks.front(), *replies, ec);
+                    }
+                    else
+                    {
+                        co_await upload_bundle(stream, tasks, *replies, ec);
+                    }
+                    streams_.erase(stream);
+                    credits_.erase(stream);
+                    wakeup_.cancel();
+                },
+                boost::asio::detached);
+        }
+        if (padding_files_.empty() && streams_.empty())
+        {
+            co_await send_keepalive(ec);
+            if (ec)
+            {
+                LOG_ERROR("{} keepalive error {}", id_, ec.message());
+                break;
+            }
+        }
+        wakeup_.expires_at(boost::asio::steady_timer::time_point::max());
+        co_await wakeup_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        ec = {};
+    }
+}
+
+boost::asio::awaitable<void> upload_session::upload_file(uint32_t stream,
+                                                         const upload_task& task,
+                                                         reply_channel& replies,
+                                                         boost::beast::error_code& ec)
+{
+    const auto& filename = task.filename;
+    auto ctx = co_await leaf::dio::instance().run(filename, [&]() { return create_upload_context(task, ec); });
+    if (ec)
+    {
+        LOG_ERROR("{} create upload context {} error {}", id_, filename, ec.message());
+        co_return;
+    }
+    ctx.stream = stream;
+    if (task.length == 0)
+    {
+        stripe_file(ctx, task.priority);
+    }
+    // 整个文件上传时请求签名, 服务端没有这个文件时按完整上传回复
+    ctx.request.delta = ctx.request.length == 0 && options_.has(leaf::kCapDeltaUpload);
+    // 分段上传的文件由多个连接写入, 不参与去重
+    if (ctx.request.length == 0 && options_.has(leaf::kCapDedupUpload))
+    {
+        boost::system::error_code hash_ec;
+        ctx.request.hash = co_await leaf::dio::instance().run(filename, [&]() { return leaf::hash_file(filename, hash_ec); });
+        if (hash_ec)
+        {
+            LOG_ERROR("{} hash file {} error {}", id_, filename, hash_ec.message());
+            ctx.request.hash.clear();
+        }
+    }
+    co_await send_upload_file_request(ctx, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} send upload file request stream {} error {}", id_, stream, ec.message());
+        co_return;
+    }
+    auto response = co_await wait_reply(replies, leaf::message_type::upload_file_response, ec);
+    if (!ec)
+    {
+        on_upload_file_response(ctx, response, ec);
+    }
+    if (ec)
+    {
+        LOG_ERROR("{} wait upload file response stream {} error {}", id_, stream, ec.message());
+        co_return;
+    }
+    if (ctx.deduplicated)
+    {
+        upload_event u;
+        u.upload_size = ctx.file->file_size;
+        u.file_size = ctx.file->file_size;
+        u.filename = ctx.file->filename;
+        emit_event(u);
+        LOG_INFO("{} upload file {} stream {} deduplicated", id_, filename, stream);
+        co_return;
+    }
+    if (ctx.signature.empty())
+    {
+        co_await send_file_data(ctx, ec);
+    }
+    else
+    {
+        co_await send_file_delta(ctx, ec);
+    }
+    if (ec)
+    {
+        LOG_ERROR("{} send file data stream {} error {}", id_, stream, ec.message());
+        co_return;
+    }
+    // 服务端落盘并校验后回复 done
+    co_await wait_reply(replies, leaf::message_type::done, ec);
+    if (ec)
+    {
+        LOG_ERROR("{} wait file done stream {} error {}", id_, stream, ec.message());
+        co_return;
+    }
+    LOG_INFO("{} upload file {} stream {} complete", id_, filename, stream);
+}
+
+std::vector<leaf::upload_session::upload_task> upload_session::take_tasks()
+{
+    std::vector<upload_task> tasks{padding_files_.pop()};
+    // 连续的整个文件一起打包, 大文件在 upload_bundle 中标记后重新排队
+    if (!options_.has(leaf::kCapBundleUpload) || tasks.front().length != 0 || tasks.front().standalone)
+    {
+        return tasks;
+    }
+    while (!padding_files_.empty() && tasks.size() < kBundleMaxFiles)
+    {
+        const auto& task = padding_files_.front();
+        // 只和同一类的文件打包, 等待中的 interactive 文件不会被一起打包的 bulk 文件拖慢
+        if (task.length != 0 || task.standalone || task.priority != tasks.front().priority)
+        {
+            break;
+        }
+        tasks.push_back(padding_files_.pop());
+    }
+    return tasks;
+}
+
+void upload_session::requeue_standalone(const std::vector<upload_task>& tasks)
+{
+    for (auto task : tasks)
+    {
+        task.standalone = true;
+        padding_files_.push(task);
+    }
+    if (!tasks.empty())
+    {
+        wakeup_.cancel();
+    }
+}
+
+// 小文件整个读入内存
+static std::vector<uint8_t> read_small_file(const std::string& filename, uint64_t file_size, boost::system::error_code& ec)
+{
+    std::vector<uint8_t> data(file_size);
+    leaf::file_reader reader(filename);
+    ec = reader.open();
+    if (ec)
+    {
+        return {};
+    }
+    std::size_t offset = 0;
+    while (offset < data.size())
+    {
+        auto read_size = reader.read(data.data() + offset, data.size() - offset, ec);
+        if (ec)
+        {
+            break;
+        }
+        offset += read_size;
+    }
+    auto close_ec = reader.close();
+    if (!ec)
+    {
+        ec = close_ec;
+    }
+    return data;
+}
+
+boost::asio::awaitable<void> upload_session::upload_bundle(uint32_t stream,
+                                                           const std::vector<upload_task>& tasks,
+                                                           reply_channel& replies,
+                                                           boost::beast::error_code& ec)
+{
+    // 大文件和读取失败的文件单独上传, 错误在单独上传时报告
+    leaf::bundle_request req;
+    std::vector<upload_task> bundled;
+    std::vector<upload_task> standalone;
+    co_await leaf::dio::instance().run(tasks.front().filename,
+                                       [&]()
+                                       {
+                                           uint64_t total = 0;
+                                           // 服务端按文件名写入 .tmp, 不同目录的同名文件不能放进同一个 bundle
+                                           std::unordered_set<std::string> names;
+                                           for (const auto& task : tasks)
+                                           {
+                                               auto filename = std::filesystem::path(task.filename).filename().string();
+                                               if (names.contains(filename))
+                                               {
+                                                   standalone.push_back(task);
+                                                   continue;
+                                               }
+                                               boost::system::error_code file_ec;
+                                               auto file_size = std::filesystem::file_size(task.filename, file_ec);
+                                               if (file_ec || file_size > kBundleFileSize || total + file_size > kBundleMaxSize)
+                                               {
+                                                   standalone.push_back(task);
+                                                   continue;
+                                               }
+                                               auto hash = leaf::hash_file(task.filename, file_ec);
+                                               if (file_ec)
+                                               {
+                                                   standalone.push_back(task);
+                                                   continue;
+                                               }
+                                               names.insert(filename);
+                                               req.files.push_back(leaf::bundle_entry{filename, file_size, hash});
+                                               bundled.push_back(task);
+                                               total += file_size;
+                                           }
+                                       });
+    requeue_standalone(standalone);
+    if (bundled.empty())
+    {
+        co_return;
+    }
+    req.id = seq_++;
+    LOG_INFO("{} upload bundle stream {} files {}", id_, stream, req.files.size());
+    auto bytes = leaf::serialize_bundle_request(req, options_.codec);
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+    if (!ec)
+    {
+        co_await wait_reply(replies, leaf::message_type::upload_file_response, ec);
+    }
+    if (ec)
+    {
+        LOG_ERROR("{} upload bundle stream {} request error {}", id_, stream, ec.message());
+        requeue_standalone(bundled);
+        co_return;
+    }
+    // 所有文件的内容连续写入大消息, 消息边界与文件边界无关
+    auto block = std::make_shared<std::vector<uint8_t>>();
+    auto block_size = sizer_.size();
+    block->reserve(block_size);
+    for (std::size_t i = 0; !ec && i < bundled.size(); i++)
+    {
+        const auto& path = bundled[i].filename;
+        auto file_size = req.files[i].filesize;
+        auto data = co_await leaf::dio::instance().run(path, [&]() { return read_small_file(path, file_size, ec); });
+        std::span<const uint8_t> rest(data);
+        while (!ec && !rest.empty())
+        {
+            auto size = std::min<std::size_t>(rest.size(), block_size - block->size());
+            block->insert(block->end(), rest.begin(), rest.begin() + static_cast<std::ptrdiff_t>(size));
+            rest = rest.subspan(size);
+            if (block->size() == block_size)
+            {
+                co_await send_bundle_block(stream, block, ec);
+                block = std::make_shared<std::vector<uint8_t>>();
+                block_size = sizer_.size();
+                block->reserve(block_size);
+            }
+        }
+    }
+    if (!ec && !block->empty())
+    {
+        co_await send_bundle_block(stream, block, ec);
+    }
+    // 读取出错时也发送 done, 服务端清理未完成的文件
+    boost::beast::error_code done_ec;
+    co_await send_file_done(stream, done_ec);
+    if (!done_ec)
+    {
+        co_await wait_reply(replies, leaf::message_type::done, done_ec);
+    }
+    ec = ec ? ec : done_ec;
+    if (ec)
+    {
+        LOG_ERROR("{} upload bundle stream {} error {}", id_, stream, ec.message());
+        requeue_standalone(bundled);
+        co_return;
+    }
+    for (const auto& file : req.files)
+    {
+        upload_event u;
+        u.upload_size = file.filesize;
+        u.file_size = file.filesize;
+        u.filename = file.filename;
+        emit_event(u);
+    }
+    LOG_INFO("{} upload bundle stream {} files {} complete", id_, stream, req.files.size());
+}
+
+boost::asio::awaitable<void> upload_session::send_bundle_block(uint32_t stream,
+                                                               std::shared_ptr<std::vector<uint8_t>> block,
+                                                               boost::beast::error_code& ec)
+{
+    leaf::blake2b hash;
+    hash.update(block->data(), static_cast<uint32_t>(block->size()));
+    hash.final();
+    auto frame = leaf::serialize_file_data(hash.hex(), boost::asio::buffer(block->data(), block->size()), block);
+    leaf::set_message_stream(frame.header, stream);
+    co_await acquire_credit(stream, ec);
+    if (ec)
+    {
+        co_return;
+    }
+    co_await leaf::governed_send(channel_, budget_, std::move(frame), ec);
+}
+
+boost::asio::awaitable<void> upload_session::acquire_credit(uint32_t stream, boost::beast::error_code& ec)
+{
+    auto it = credits_.find(stream);
+    if (it == credits_.end())
+    {
+        co_return;
+    }
+    // 等待期间 stream 可能结束, 持有窗口
+    auto credits = it->second;
+    co_await credits->acquire(ec);
+}
+
+void upload_session::on_credit(std::span<const uint8_t> message)
+{
+    auto c = leaf::deserialize_credit(message);
+    if (!c.has_value())
+    {
+        LOG_ERROR("{} credit message invalid", id_);
+        return;
+    }
+    auto it = credits_.find(leaf::get_message_stream(message));
+    if (it != credits_.end())
+    {
+        it->second->grant(c->count);
+    }
+}
+
+boost::asio::awaitable<std::vector<uint8_t>> upload_session::wait_reply(reply_channel& replies,
+                                                                        leaf::message_type expect,
+                                                                        boost::beast::error_code& ec)
+{
+    auto message = co_await replies.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec)
+    {
+        co_return message;
+    }
+    auto type = leaf::get_message_type(message);
+    if (type == leaf::message_type::error)
+    {
+        auto e = leaf::deserialize_error_message(message);
+        ec = boost::system::error_code(e.has_value() ? e->error : EPROTO, boost::system::generic_category());
+        co_return message;
+    }
+    if (type != expect)
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+    }
+    co_return message;
+}
+
+boost::asio::awaitable<void> upload_session::recv_coro()
+{
+    boost::beast::error_code ec;
+    boost::beast::flat_buffer buffer;
+    while (true)
+    {
+        buffer.consume(buffer.size());
+        co_await ws_client_->read(ec, buffer);
+        if (ec)
+        {
+            LOG_ERROR("{} recv coro error {}", id_, ec.message());
+            break;
+        }
+        auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
+        auto type = leaf::get_message_type(message);
+        if (type == leaf::message_type::keepalive)
+        {
+            on_keepalive(message, ec);
+            if (ec)
+            {
+                break;
+            }
+            continue;
+        }
+        if (type == leaf::message_type::credit)
+        {
+            on_credit(message);
+            continue;
+        }
+        auto stream = leaf::get_message_stream(message);
+        auto it = streams_.find(stream);
+        if (it == streams_.end())
+        {
+            LOG_ERROR("{} recv coro message {} unknown stream {}", id_, static_cast<int>(type), stream);
+            continue;
+        }
+        // 服务端关闭了出错的 stream, 不再归还信用, 唤醒等待中的发送去读取错误
+        auto credits = credits_.find(stream);
+        if (type == leaf::message_type::error && credits != credits_.end())
+        {
+            credits->second->close();
+        }
+        auto replies = it->second;
+        co_await replies->async_send(boost::system::error_code{},
+                                     std::vector<uint8_t>(message.begin(), message.end()),
+                                     boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        ec = {};
+    }
+    // 连接断开, 唤醒所有等待中的 stream
+    for (auto& [stream, replies] : streams_)
+    {
+        replies->close();
+    }
+    for (auto& [stream, credits] : credits_)
+    {
+        credits->close();
+    }
+    stopped_ = true;
+    wakeup_.cancel();
 }
 
 boost::asio::awaitable<void> upload_session::write_coro()
@@ -101,13 +569,15 @@ boost::asio::awaitable<void> upload_session::write_coro()
     while (true)
     {
         boost::system::error_code ec;
-        auto bytes = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto frame = co_await channel_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
         if (ec)
         {
             LOG_ERROR("{} write coro error {}", id_, ec.message());
             break;
         }
-        co_await ws_client_->write(ec, bytes.data(), bytes.size());
+        auto start = std::chrono::steady_clock::now();
+        co_await ws_client_->write(ec, frame.buffers());
+        sizer_.on_write(frame.size(), std::chrono::steady_clock::now() - start);
         if (ec)
         {
             LOG_ERROR("{} write coro error {}", id_, ec.message());
@@ -118,6 +588,8 @@ boost::asio::awaitable<void> upload_session::write_coro()
 }
 boost::asio::awaitable<void> upload_session::shutdown_coro()
 {
+    stopped_ = true;
+    wakeup_.cancel();
     if (ws_client_)
     {
         channel_.close();
@@ -133,31 +605,84 @@ void upload_session::shutdown()
     boost::asio::co_spawn(
         io_, [this, self = shared_from_this()]() -> boost::asio::awaitable<void> { co_await shutdown_coro(); }, boost::asio::detached);
 }
-void upload_session::safe_add_file(const std::string& filename)
+void upload_session::safe_add_tasks(const std::vector<upload_task>& tasks)
 {
-    LOG_INFO("{} add file {}", id_, filename);
-    padding_files_.push_back(filename);
-}
-void upload_session::safe_add_files(const std::vector<std::string>& files)
-{
-    for (const auto& filename : files)
+    for (const auto& task : tasks)
     {
-        padding_files_.push_back(filename);
+        LOG_INFO("{} add file {} range {} {} size {} priority {}",
+                 id_,
+                 task.filename,
+                 task.offset,
+                 task.length,
+                 task.size,
+                 static_cast<int>(task.priority));
+        padding_files_.push(task);
     }
+    wakeup_.cancel();
 }
 
-void upload_session::add_file(const std::string& filename)
+void upload_session::add_range(const std::string& filename, uint64_t offset, uint64_t length, leaf::transfer_priority priority)
 {
-    io_.post([this, filename, self = shared_from_this()]() { safe_add_file(filename); });
+    std::vector<upload_task> tasks{upload_task{filename, offset, length, false, length, priority}};
+    io_.post([this, tasks, self = shared_from_this()]() { safe_add_tasks(tasks); });
 }
 
-void upload_session::add_files(const std::vector<std::string>& files)
+void upload_session::set_priority(const std::string& filename, leaf::transfer_priority priority)
 {
-    io_.post([this, files, self = shared_from_this()]() { safe_add_files(files); });
+    io_.post([this, filename, priority, self = shared_from_this()]() { padding_files_.set_priority(filename, priority); });
 }
 
-leaf::upload_session::upload_context upload_session::create_upload_context(const std::string& filename, boost::beast::error_code& ec)
+void upload_session::set_smallest_first(bool enable)
 {
+    io_.post([this, enable, self = shared_from_this()]() { padding_files_.set_smallest_first(enable); });
+}
+
+void upload_session::set_stripes(std::vector<std::shared_ptr<leaf::upload_session>> stripes) { stripes_ = std::move(stripes); }
+
+void upload_session::stripe_file(leaf::upload_session::upload_context& ctx, leaf::transfer_priority priority)
+{
+    if (!options_.has(leaf::kCapStripedUpload) || stripes_.empty() || ctx.file->file_size < kStripeMinFileSize)
+    {
+        return;
+    }
+    // 每个连接一个范围, 范围按块大小对齐, 第一个范围由当前连接上传
+    auto count = stripes_.size() + 1;
+    auto range_size = (ctx.file->file_size + count - 1) / count;
+    range_size = (range_size + options_.block_size - 1) / options_.block_size * options_.block_size;
+    ctx.request.length = std::min<uint64_t>(range_size, ctx.file->file_size);
+    uint64_t offset = ctx.request.length;
+    for (const auto& stripe : stripes_)
+    {
+        if (offset >= ctx.file->file_size)
+        {
+            break;
+        }
+        auto length = std::min<uint64_t>(range_size, ctx.file->file_size - offset);
+        stripe->add_range(ctx.file->file_path, offset, length, priority);
+        offset += length;
+    }
+    LOG_INFO("{} upload file {} size {} striped range size {}", id_, ctx.file->file_path, ctx.file->file_size, range_size);
+}
+
+void upload_session::add_file(const std::string& filename, leaf::transfer_priority priority) { add_files({filename}, priority); }
+
+void upload_session::add_files(const std::vector<std::string>& files, leaf::transfer_priority priority)
+{
+    // 在调用者的线程上读取文件大小, 读取失败时大小未知, 上传时报告错误
+    std::vector<upload_task> tasks;
+    tasks.reserve(files.size());
+    for (const auto& filename : files)
+    {
+        boost::system::error_code ec;
+        auto size = std::filesystem::file_size(filename, ec);
+        tasks.push_back(upload_task{filename, 0, 0, false, ec ? 0 : size, priority});
+    }
+    io_.post([this, tasks, self = shared_from_this()]() { safe_add_tasks(tasks); });
+}
+
+leaf::upload_session::upload_context upload_session::create_upload_context(const upload_task& task, boost::beast::error_code& ec)
+{
+    const auto& filename = task.filename;
     auto file_size = std::filesystem::file_size(filename, ec);
     if (ec)
     {
@@ -167,8 +692,11 @@ leaf::upload_session::upload_context upload_session::create_upload_context(const
     file->file_path = filename;
     file->filename = std::filesystem::path(filename).filename().string();
     file->file_size = file_size;
+    file->offset = static_cast<int64_t>(task.offset);
     leaf::upload_session::upload_context ctx;
     ctx.file = file;
+    ctx.request.offset = task.offset;
+    ctx.request.length = task.length;
     return ctx;
 }
 
@@ -178,17 +706,30 @@ boost::asio::awaitable<void> upload_session::send_upload_file_request(leaf::uplo
     u.id = seq_++;
     u.filename = std::filesystem::path(ctx.file->file_path).filename().string();
     u.filesize = ctx.file->file_size;
-    LOG_DEBUG("{} upload_file request {} filename {} filesize {}", id_, u.id, ctx.file->file_path, ctx.file->file_size);
-    co_await channel_.async_send(ec, leaf::serialize_upload_file_request(u), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    u.offset = ctx.request.offset;
+    u.length = ctx.request.length;
+    u.delta = ctx.request.delta;
+    u.hash = ctx.request.hash;
+    LOG_DEBUG("{} upload_file request {} stream {} filename {} filesize {} range {} {}",
+              id_,
+              u.id,
+              ctx.stream,
+              ctx.file->file_path,
+              ctx.file->file_size,
+              u.offset,
+              u.length);
+    auto bytes = leaf::serialize_upload_file_request(u, options_.codec);
+    leaf::set_message_stream(bytes, ctx.stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
 boost::asio::awaitable<void> upload_session::send_ack(boost::beast::error_code& ec)
 {
     leaf::ack a;
-    co_await channel_.async_send(ec, leaf::serialize_ack(a), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::serialize_ack(a)), ec);
 }
 
-boost::asio::awaitable<void> upload_session::wait_upload_file_response(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_session::wait_upload_file_response(leaf::upload_session::upload_context& ctx, boost::beast::error_code& ec)
 {
     boost::beast::flat_buffer buffer;
     co_await ws_client_->read(ec, buffer);
@@ -204,17 +745,62 @@ boost::asio::awaitable<void> upload_session::wait_upload_file_response(boost::be
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         co_return;
     }
-    auto response = leaf::deserialize_upload_file_response(std::vector<uint8_t>(message.begin(), message.end()));
+    on_upload_file_response(ctx, std::vector<uint8_t>(message.begin(), message.end()), ec);
+}
+
+void upload_session::on_upload_file_response(leaf::upload_session::upload_context& ctx,
+                                             const std::vector<uint8_t>& message,
+                                             boost::beast::error_code& ec)
+{
+    auto response = leaf::deserialize_upload_file_response(message);
     if (!response.has_value())
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
-        co_return;
+        return;
+    }
+    LOG_DEBUG("{} upload_file response {} filename {} offset {} delta blocks {}",
+              id_,
+              response->id,
+              response->filename,
+              response->offset,
+              response->signature.size());
+    if (response->deduplicated)
+    {
+        if (ctx.request.hash.empty())
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+            return;
+        }
+        ctx.deduplicated = true;
+        return;
+    }
+    if (!response->signature.empty())
+    {
+        if (!ctx.request.delta || response->offset != 0 || response->delta_block_size == 0)
+        {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+            return;
+        }
+        ctx.delta_block_size = response->delta_block_size;
+        ctx.signature = std::move(response->signature);
+        return;
+    }
+    if (response->offset == 0)
+    {
+        return;
     }
-    LOG_DEBUG("{} upload_file response {} filename {}", id_, response->id, response->filename);
+    // 服务端已有校验过的数据, 从断点继续发送
+    if (ctx.request.length != 0 || response->offset > ctx.file->file_size)
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return;
+    }
+    ctx.file->offset = static_cast<int64_t>(response->offset);
+    LOG_INFO("{} upload_file {} resume from {}", id_, ctx.file->file_path, response->offset);
 }
 boost::asio::awaitable<void> upload_session::send_file_data(leaf::upload_session::upload_context& ctx, boost::beast::error_code& ec)
 {
-    auto reader = std::make_shared<leaf::file_reader>(ctx.file->file_path);
+    auto reader = std::make_shared<leaf::async_file_reader>(io_.get_executor(), ctx.file->file_path);
     if (reader == nullptr)
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::not_enough_memory);
@@ -227,54 +813,70 @@ boost::asio::awaitable<void> upload_session::send_file_data(leaf::upload_session
         co_return;
     }
     auto hash = std::make_shared<leaf::blake2b>();
+    // 分段上传只读取 [offset, offset + length), 续传时从断点开始
+    auto end = ctx.request.length != 0 ? ctx.request.offset + ctx.request.length : ctx.file->file_size;
+    auto range_size = end - static_cast<uint64_t>(ctx.file->offset);
+    // 数据块大小会变化, hash 窗口按字节计算
+    const uint64_t window_size = static_cast<uint64_t>(options_.block_size) * options_.hash_block_count;
+    uint64_t window_bytes = 0;
 
-    uint8_t buffer[kBlockSize] = {0};
     while (true)
     {
-        assert(reader->size() < ctx.file->file_size);
-        auto read_size = reader->read_at(ctx.file->offset, buffer, kBlockSize, ec);
+        assert(reader->size() <= range_size);
+        // 每个块读入独立的缓冲区, 由发送中的 frame 持有, 数据不再拷贝进消息
+        auto block = std::make_shared<std::vector<uint8_t>>(std::min<uint64_t>(sizer_.size(), end - ctx.file->offset));
+        auto read_size = co_await reader->read_at(ctx.file->offset, block->data(), block->size(), ec);
         if (ec && ec != boost::asio::error::eof)
         {
             LOG_ERROR("{} upload_file read file {} error {}", id_, ctx.file->file_path, ec.message());
             break;
         }
-        leaf::file_data fd;
-        fd.data.insert(fd.data.end(), buffer, buffer + read_size);
         if (read_size != 0)
         {
             ctx.file->hash_count++;
             ctx.file->offset += static_cast<int64_t>(read_size);
-            hash->update(fd.data.data(), read_size);
+            window_bytes += read_size;
+            hash->update(block->data(), read_size);
         }
-        // block count hash or eof hash
-        if (ctx.file->file_size == reader->size() || ctx.file->hash_count == kHashBlockCount || ec == boost::asio::error::eof)
+        std::string block_hash;
+        // window hash or eof hash
+        if (range_size == reader->size() || window_bytes >= window_size || ec == boost::asio::error::eof)
         {
             hash->final();
-            fd.hash = hash->hex();
+            block_hash = hash->hex();
             ctx.file->hash_count = 0;
+            window_bytes = 0;
             hash = std::make_shared<leaf::blake2b>();
         }
-        LOG_DEBUG("{} upload_file {} size {} hash {}", id_, ctx.file->file_path, read_size, fd.hash.empty() ? "empty" : fd.hash);
+        LOG_DEBUG("{} upload_file {} size {} hash {}", id_, ctx.file->file_path, read_size, block_hash.empty() ? "empty" : block_hash);
         upload_event u;
         u.upload_size = reader->size();
-        u.file_size = ctx.file->file_size;
+        u.file_size = range_size;
         u.filename = ctx.file->filename;
         emit_event(u);
 
-        if (!fd.data.empty())
+        if (read_size != 0)
         {
-            co_await channel_.async_send(ec, leaf::serialize_file_data(fd), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            auto frame = leaf::serialize_file_data(block_hash, boost::asio::buffer(block->data(), read_size), block);
+            leaf::set_message_stream(frame.header, ctx.stream);
+            co_await acquire_credit(ctx.stream, ec);
+            if (ec)
+            {
+                break;
+            }
+            co_await leaf::governed_send(channel_, budget_, std::move(frame), ec);
             if (ec)
             {
                 break;
             }
         }
 
-        if (ec == boost::asio::error::eof || reader->size() == ctx.file->file_size)
+        if (ec == boost::asio::error::eof || reader->size() == range_size)
         {
             LOG_INFO("{} upload_file {} complete", id_, ctx.file->file_path);
             ec = {};
-            co_await send_file_done(ec);
+            co_await send_file_done(ctx.stream, ec);
+            break;
         }
     }
     ec = reader->close();
@@ -284,10 +886,83 @@ boost::asio::awaitable<void> upload_session::send_file_data(leaf::upload_session
     }
 }
 
-boost::asio::awaitable<void> upload_session::send_file_done(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_session::send_file_delta(leaf::upload_session::upload_context& ctx, boost::beast::error_code& ec)
+{
+    // 本地文件只读映射, 字面数据直接从映射区发送, 由 frame 持有映射
+    auto source = std::make_shared<leaf::mmap_file_reader>(ctx.file->file_path);
+    auto ops = co_await leaf::dio::instance().run(ctx.file->file_path,
+                                                  [&]() -> std::vector<leaf::delta_op>
+                                                  {
+                                                      ec = source->open();
+                                                      if (ec || source->size() != ctx.file->file_size)
+                                                      {
+                                                          return {};
+                                                      }
+                                                      return leaf::make_delta(*source, ctx.delta_block_size, ctx.signature);
+                                                  });
+    if (!ec && source->size() != ctx.file->file_size)
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::file_too_large);
+    }
+    if (ec)
+    {
+        LOG_ERROR("{} upload_file {} delta error {}", id_, ctx.file->file_path, ec.message());
+        co_return;
+    }
+    uint64_t literal_size = 0;
+    uint64_t upload_size = 0;
+    for (const auto& op : ops)
+    {
+        if (op.copy)
+        {
+            auto bytes = leaf::serialize_delta_copy(leaf::delta_copy{op.index, op.count}, options_.codec);
+            leaf::set_message_stream(bytes, ctx.stream);
+            co_await acquire_credit(ctx.stream, ec);
+            if (ec)
+            {
+                co_return;
+            }
+            co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
+            upload_size += static_cast<uint64_t>(op.count) * ctx.delta_block_size;
+        }
+        // 字面数据每个消息单独校验, 块引用之间没有连续的 hash 窗口
+        for (uint64_t sent = 0; !ec && sent < op.length;)
+        {
+            auto block = source->slice(op.offset + sent, std::min<uint64_t>(sizer_.size(), op.length - sent));
+            leaf::blake2b hash;
+            hash.update(block.data(), static_cast<uint32_t>(block.size()));
+            hash.final();
+            auto frame = leaf::serialize_file_data(hash.hex(), block, source);
+            leaf::set_message_stream(frame.header, ctx.stream);
+            co_await acquire_credit(ctx.stream, ec);
+            if (ec)
+            {
+                break;
+            }
+            co_await leaf::governed_send(channel_, budget_, std::move(frame), ec);
+            sent += block.size();
+            literal_size += block.size();
+            upload_size += block.size();
+        }
+        if (ec)
+        {
+            co_return;
+        }
+        upload_event u;
+        u.upload_size = upload_size;
+        u.file_size = ctx.file->file_size;
+        u.filename = ctx.file->filename;
+        emit_event(u);
+    }
+    LOG_INFO("{} upload_file {} delta complete ops {} literal {} of {}", id_, ctx.file->file_path, ops.size(), literal_size, ctx.file->file_size);
+    co_await send_file_done(ctx.stream, ec);
+}
+
+boost::asio::awaitable<void> upload_session::send_file_done(uint32_t stream, boost::beast::error_code& ec)
 {
-    leaf::done d;
-    co_await channel_.async_send(ec, leaf::serialize_done(d), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    auto bytes = leaf::serialize_done(leaf::done{});
+    leaf::set_message_stream(bytes, stream);
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(std::move(bytes)), ec);
 }
 
 void upload_session::emit_event(const leaf::upload_event& e) const
@@ -300,22 +975,53 @@ void upload_session::emit_event(const leaf::upload_event& e) const
 
 void upload_session::padding_file_event()
 {
-    for (const auto& filename : padding_files_)
-    {
-        upload_event e;
-        e.filename = filename;
-        LOG_DEBUG("padding files {}", e.filename);
-        emit_event(e);
-    }
+    padding_files_.for_each(
+        [this](const upload_task& task)
+        {
+            upload_event e;
+            e.filename = task.filename;
+            LOG_DEBUG("padding files {}", e.filename);
+            emit_event(e);
+        });
 }
-boost::asio::awaitable<void> upload_session::keepalive(boost::beast::error_code& ec)
+boost::asio::awaitable<void> upload_session::send_keepalive(boost::beast::error_code& ec)
 {
     leaf::keepalive k;
     k.id = 0;
     k.client_id = reinterpret_cast<uintptr_t>(this);
     k.client_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     k.server_timestamp = 0;
-    co_await channel_.async_send(ec, leaf::serialize_keepalive(k), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    co_await leaf::governed_send(channel_, budget_, leaf::websocket_frame(leaf::serialize_keepalive(k, options_.codec)), ec);
+}
+
+void upload_session::on_keepalive(std::span<const uint8_t> message, boost::beast::error_code& ec)
+{
+    auto kk = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
+    if (!kk.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return;
+    }
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (kk->client_id == reinterpret_cast<uintptr_t>(this) && static_cast<uint64_t>(now) >= kk->client_timestamp)
+    {
+        sizer_.on_rtt(std::chrono::milliseconds(static_cast<uint64_t>(now) - kk->client_timestamp));
+    }
+    LOG_DEBUG("{} on_keepalive client {} server_timestamp {} client_timestamp {} token {}",
+              id_,
+              kk->client_id,
+              kk->server_timestamp,
+              kk->client_timestamp,
+              token_);
+}
+
+boost::asio::awaitable<void> upload_session::keepalive(boost::beast::error_code& ec)
+{
+    co_await send_keepalive(ec);
+    if (ec)
+    {
+        co_return;
+    }
     boost::beast::flat_buffer buffer;
     co_await ws_client_->read(ec, buffer);
     if (ec)
@@ -323,25 +1029,30 @@ boost::asio::awaitable<void> upload_session::keepalive(boost::beast::error_code&
         LOG_ERROR("{} wait keepalive error {}", id_, ec.message());
         co_return;
     }
-    auto message = boost::beast::buffers_to_string(buffer.data());
+    auto message = std::span<const uint8_t>(static_cast<const uint8_t*>(buffer.data().data()), buffer.size());
     auto type = leaf::get_message_type(message);
     if (type != leaf::message_type::keepalive)
     {
         ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
         co_return;
     }
-    auto kk = leaf::deserialize_keepalive_response(std::vector<uint8_t>(message.begin(), message.end()));
-    if (!kk.has_value())
+    on_keepalive(message, ec);
+}
+
+boost::asio::awaitable<void> upload_session::wait_login(const leaf::login_token& hello, boost::beast::error_code& ec)
+{
+    co_await leaf::read_login(*ws_client_, hello, options_, &sizer_, ec);
+    if (ec)
     {
-        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        LOG_ERROR("{} wait login error {}", id_, ec.message());
         co_return;
     }
-    LOG_DEBUG("{} on_keepalive client {} server_timestamp {} client_timestamp {} token {}",
-              id_,
-              kk->client_id,
-              kk->server_timestamp,
-              kk->client_timestamp,
-              token_);
+    LOG_INFO("{} login success version {} capabilities {} block size {} window {}",
+             id_,
+             options_.version,
+             options_.capabilities,
+             options_.block_size,
+             options_.window);
 }
 
 }    // namespace leaf
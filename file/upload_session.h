@@ -1,13 +1,21 @@
 #ifndef LEAF_FILE_UPLOAD_SESSION_H
 #define LEAF_FILE_UPLOAD_SESSION_H
 
-#include <deque>
+#include <map>
+#include <span>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/experimental/channel.hpp>
 #include "file/file.h"
 #include "file/event.h"
 #include "crypt/blake2b.h"
 #include "protocol/message.h"
+#include "protocol/capability.h"
 #include "file/file_context.h"
+#include "file/block_sizer.h"
+#include "file/credit_window.h"
+#include "file/transfer_queue.h"
+#include "file/memory_governor.h"
+#include "net/websocket_frame.h"
 #include "net/plain_websocket_client.h"
 
 namespace leaf
@@ -16,9 +24,26 @@ class upload_session : public std::enable_shared_from_this<upload_session>
 {
     struct upload_context
     {
+        uint32_t stream = 0;
         leaf::upload_file_request request;
         std::shared_ptr<leaf::file_info> file;
+        // 服务端已有文件的签名, 不为空时增量上传
+        uint32_t delta_block_size = 0;
+        std::vector<leaf::delta_block> signature;
+        bool deduplicated = false;    // 服务端已有相同内容
     };
+    // 待上传的文件, length 不为 0 时只上传文件的一个范围
+    struct upload_task
+    {
+        std::string filename;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        bool standalone = false;    // 不参与打包
+        uint64_t size = 0;          // 排队使用的大小, 0 表示未知
+        leaf::transfer_priority priority = leaf::transfer_priority::bulk;
+    };
+    // 每个 stream 的控制消息由 recv_coro 分发
+    using reply_channel = boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)>;
 
    public:
     upload_session(std::string id, std::string host, std::string port, std::string token, leaf::upload_handle handler, boost::asio::io_context &io);
@@ -28,36 +53,76 @@ class upload_session : public std::enable_shared_from_this<upload_session>
    public:
     void startup();
     void shutdown();
-    void add_file(const std::string &filename);
-    void add_files(const std::vector<std::string> &files);
+    void add_file(const std::string &filename, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    void add_files(const std::vector<std::string> &files, leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    void add_range(const std::string &filename,
+                   uint64_t offset,
+                   uint64_t length,
+                   leaf::transfer_priority priority = leaf::transfer_priority::bulk);
+    // 修改还在排队的文件的优先级, 已经开始传输的不受影响
+    void set_priority(const std::string &filename, leaf::transfer_priority priority);
+    void set_smallest_first(bool enable);
+    // 大文件的其他范围交给这些连接并发上传
+    void set_stripes(std::vector<std::shared_ptr<leaf::upload_session>> stripes);
     boost::asio::awaitable<void> upload_coro();
     boost::asio::awaitable<void> write_coro();
+    boost::asio::awaitable<void> recv_coro();
+    boost::asio::awaitable<void> sequential_upload(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> multiplex_upload(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> upload_file(uint32_t stream, const upload_task &task, reply_channel &replies, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> upload_bundle(uint32_t stream,
+                                               const std::vector<upload_task> &tasks,
+                                               reply_channel &replies,
+                                               boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_bundle_block(uint32_t stream, std::shared_ptr<std::vector<uint8_t>> block, boost::beast::error_code &ec);
+    boost::asio::awaitable<std::vector<uint8_t>> wait_reply(reply_channel &replies, leaf::message_type expect, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> wait_login(const leaf::login_token &hello, boost::beast::error_code &ec);
     boost::asio::awaitable<void> shutdown_coro();
-    static leaf::upload_session::upload_context create_upload_context(const std::string &filename, boost::beast::error_code &ec);
+    static leaf::upload_session::upload_context create_upload_context(const upload_task &task, boost::beast::error_code &ec);
     boost::asio::awaitable<void> send_upload_file_request(leaf::upload_session::upload_context &ctx, boost::beast::error_code &ec);
-    boost::asio::awaitable<void> wait_upload_file_response(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> wait_upload_file_response(leaf::upload_session::upload_context &ctx, boost::beast::error_code &ec);
+    void on_upload_file_response(leaf::upload_session::upload_context &ctx, const std::vector<uint8_t> &message, boost::beast::error_code &ec);
     boost::asio::awaitable<void> send_ack(boost::beast::error_code &ec);
     boost::asio::awaitable<void> send_file_data(leaf::upload_session::upload_context &ctx, boost::beast::error_code &ec);
-    boost::asio::awaitable<void> send_file_done(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_file_delta(leaf::upload_session::upload_context &ctx, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_file_done(uint32_t stream, boost::beast::error_code &ec);
+    boost::asio::awaitable<void> acquire_credit(uint32_t stream, boost::beast::error_code &ec);
+    void on_credit(std::span<const uint8_t> message);
     boost::asio::awaitable<void> keepalive(boost::beast::error_code &ec);
+    boost::asio::awaitable<void> send_keepalive(boost::beast::error_code &ec);
+    void on_keepalive(std::span<const uint8_t> message, boost::beast::error_code &ec);
 
    private:
     void padding_file_event();
     void emit_event(const leaf::upload_event &e) const;
-    void safe_add_file(const std::string &filename);
-    void safe_add_files(const std::vector<std::string> &files);
+    void safe_add_tasks(const std::vector<upload_task> &tasks);
+    void stripe_file(leaf::upload_session::upload_context &ctx, leaf::transfer_priority priority);
+    std::vector<upload_task> take_tasks();
+    void requeue_standalone(const std::vector<upload_task> &tasks);
 
    private:
     uint32_t seq_ = 0;
+    uint32_t stream_seq_ = 0;
+    bool stopped_ = false;
     std::string id_;
     std::string host_;
     std::string port_;
     std::string token_;
+    leaf::session_options options_;
+    leaf::block_sizer sizer_{kBlockSize, kBlockSize, kBlockSize};
     boost::asio::io_context &io_;
     leaf::upload_handle handler_;
-    std::deque<std::string> padding_files_;
+    leaf::transfer_queue<upload_task> padding_files_;
+    std::vector<std::shared_ptr<leaf::upload_session>> stripes_;
     std::shared_ptr<leaf::plain_websocket_client> ws_client_;
-    boost::asio::experimental::channel<void(boost::system::error_code, std::vector<uint8_t>)> channel_{io_, 1024};
+    // 等待新文件或 stream 结束
+    boost::asio::steady_timer wakeup_{io_};
+    std::map<uint32_t, std::shared_ptr<reply_channel>> streams_;
+    // 协商了 kCapCreditFlow 时每个 stream 的发送信用
+    std::map<uint32_t, std::shared_ptr<leaf::credit_window>> credits_;
+    // 这个连接的发送额度, 消息写完前由 frame 持有
+    std::shared_ptr<leaf::memory_governor> budget_ = std::make_shared<leaf::memory_governor>(kConnectionMemoryBudget);
+    boost::asio::experimental::channel<void(boost::system::error_code, leaf::websocket_frame)> channel_{io_, 1024};
 };
 }    // namespace leaf
 
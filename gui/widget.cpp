@@ -488,5 +488,6 @@ void Widget::on_new_file_clicked()
     {
         return;
     }
-    file_client_->add_upload_file(filename.toStdString());
+    // 用户手动选择的文件排在后台传输之前
+    file_client_->add_upload_file(filename.toStdString(), leaf::transfer_priority::interactive);
 }
@@ -0,0 +1,109 @@
+#include <map>
+#include <cctype>
+#include <string>
+#include <thread>
+#include <filesystem>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#endif
+#include "net/cpu_topology.h"
+
+namespace leaf
+{
+
+int cpu_node(int cpu)
+{
+#ifdef __linux__
+    // /sys/devices/system/cpu/cpuN 下有一个指向所在节点的 nodeK 链接
+    std::error_code ec;
+    auto dir = std::filesystem::path("/sys/devices/system/cpu") / ("cpu" + std::to_string(cpu));
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        auto name = entry.path().filename().string();
+        if (name.size() > 4 && name.starts_with("node") && std::isdigit(static_cast<unsigned char>(name[4])) != 0)
+        {
+            return std::stoi(name.substr(4));
+        }
+    }
+#else
+    (void)cpu;
+#endif
+    return 0;
+}
+
+std::vector<leaf::cpu_info> available_cpus()
+{
+    std::map<int, std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                nodes[cpu_node(cpu)].push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (nodes.empty())
+    {
+        auto count = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+        for (int cpu = 0; cpu < count; cpu++)
+        {
+            nodes[0].push_back(cpu);
+        }
+    }
+    std::vector<leaf::cpu_info> cpus;
+    for (std::size_t i = 0;; i++)
+    {
+        bool added = false;
+        for (const auto& [node, list] : nodes)
+        {
+            if (i < list.size())
+            {
+                cpus.push_back(leaf::cpu_info{list[i], node});
+                added = true;
+            }
+        }
+        if (!added)
+        {
+            break;
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+int socket_incoming_cpu(boost::asio::ip::tcp::socket& socket)
+{
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (::getsockopt(socket.native_handle(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0)
+    {
+        return cpu;
+    }
+#else
+    (void)socket;
+#endif
+    return -1;
+}
+
+}    // namespace leaf
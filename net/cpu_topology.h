@@ -0,0 +1,26 @@
+#ifndef LEAF_NET_CPU_TOPOLOGY_H
+#define LEAF_NET_CPU_TOPOLOGY_H
+
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace leaf
+{
+struct cpu_info
+{
+    int cpu = 0;
+    int node = 0;    // numa 节点, 无法获取时为 0
+};
+
+// 当前进程允许使用的 cpu, 各个 numa 节点的 cpu 交替排列, 按顺序取前 n 个时各节点数量均衡
+std::vector<leaf::cpu_info> available_cpus();
+// cpu 所在的 numa 节点, 未知时返回 0
+int cpu_node(int cpu);
+// 当前线程绑定到 cpu, 不支持的平台返回 false
+bool pin_current_thread(int cpu);
+// 处理这个连接收包的 cpu (网卡队列的中断所在 cpu), 未知时返回 -1
+int socket_incoming_cpu(boost::asio::ip::tcp::socket& socket);
+
+}    // namespace leaf
+
+#endif
@@ -31,8 +31,6 @@ void detect_session::shutdown()
 void detect_session::detect()
 {
     LOG_INFO("detect {}", id_);
-    stream_.rate_policy().read_limit(kReadWsLimited);
-    stream_.rate_policy().write_limit(kWriteWsLimited);
     stream_.expires_after(std::chrono::seconds(30));
 
     boost::beast::async_detect_ssl(stream_, buffer_, boost::beast::bind_front_handler(&detect_session::safe_detect, shared_from_this()));
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include "config/config.h"
+#include "net/executor_load.h"
+
+namespace leaf
+{
+boost::asio::execution_context::id executor_load::id;
+
+executor_load::executor_load(boost::asio::execution_context& ctx) : boost::asio::execution_context::service(ctx) {}
+
+executor_load& executor_load::of(boost::asio::execution_context& ctx) { return boost::asio::use_service<executor_load>(ctx); }
+
+executor_load& executor_load::of(const boost::asio::any_io_executor& ex)
+{
+    return of(boost::asio::query(ex, boost::asio::execution::context));
+}
+
+uint64_t executor_load::score() const
+{
+    auto session = static_cast<uint64_t>(std::max<int64_t>(sessions(), 0));
+    auto queued = static_cast<uint64_t>(std::max<int64_t>(queued_bytes(), 0)) / kBlockSize;
+    auto lag = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(this->lag()).count());
+    return session + queued + lag;
+}
+
+}    // namespace leaf
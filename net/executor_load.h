@@ -0,0 +1,51 @@
+#ifndef LEAF_NET_EXECUTOR_LOAD_H
+#define LEAF_NET_EXECUTOR_LOAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <boost/asio.hpp>
+
+namespace leaf
+{
+// io_context 的负载, 作为 asio service 挂在 io_context 上, 持有 executor 的地方都可以更新
+// 所有字段都是原子变量, 选择 executor 时不加锁读取
+class executor_load : public boost::asio::execution_context::service
+{
+   public:
+    using key_type = executor_load;
+    static boost::asio::execution_context::id id;
+
+   public:
+    explicit executor_load(boost::asio::execution_context& ctx);
+
+   public:
+    static executor_load& of(boost::asio::execution_context& ctx);
+    static executor_load& of(const boost::asio::any_io_executor& ex);
+
+   public:
+    void add_session(int64_t count) { sessions_.fetch_add(count, std::memory_order_relaxed); }
+    void add_queued(int64_t bytes) { queued_bytes_.fetch_add(bytes, std::memory_order_relaxed); }
+    void set_lag(std::chrono::microseconds lag) { lag_.store(lag.count(), std::memory_order_relaxed); }
+    void set_node(int node) { node_.store(node, std::memory_order_relaxed); }
+    [[nodiscard]] int64_t sessions() const { return sessions_.load(std::memory_order_relaxed); }
+    [[nodiscard]] int64_t queued_bytes() const { return queued_bytes_.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::chrono::microseconds lag() const { return std::chrono::microseconds(lag_.load(std::memory_order_relaxed)); }
+    // 线程绑定的 numa 节点, 没有绑定时为 -1
+    [[nodiscard]] int node() const { return node_.load(std::memory_order_relaxed); }
+    // 一个会话, 一个数据块的排队数据 (含 channel 中未发送的帧), 一毫秒的事件循环延迟各记一分
+    [[nodiscard]] uint64_t score() const;
+
+   private:
+    void shutdown() override {}
+
+   private:
+    std::atomic<int64_t> sessions_{0};
+    std::atomic<int64_t> queued_bytes_{0};
+    std::atomic<int64_t> lag_{0};
+    std::atomic<int> node_{-1};
+};
+
+}    // namespace leaf
+
+#endif
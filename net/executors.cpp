@@ -1,24 +1,75 @@
+#include <random>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include "executors.h"
+#include "log/log.h"
+#include "config/config.h"
+#include "net/cpu_topology.h"
 
 using leaf::executors;
 
-static void worker(const leaf::executors::executor_ptr &ex)
+static void worker(const leaf::executors::executor_ptr &ex, int cpu)
 {
+    // 先绑定再运行, 线程之后分配的内存按首次访问落在本地 numa 节点
+    if (cpu >= 0 && !leaf::pin_current_thread(cpu))
+    {
+        LOG_ERROR("pin executor thread to cpu {} failed", cpu);
+    }
     boost::system::error_code ignore;
     ex->run(ignore);
 }
 
-executors::executors(std::size_t executor_size) : executor_size_(executor_size) {}
+// 定时器实际触发时间与预期时间的差即事件循环的延迟
+static boost::asio::awaitable<void> probe_lag(leaf::executor_load &load)
+{
+    boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+    while (true)
+    {
+        auto expected = std::chrono::steady_clock::now() + leaf::kLagProbeInterval;
+        timer.expires_at(expected);
+        boost::system::error_code ec;
+        co_await timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (ec)
+        {
+            co_return;
+        }
+        load.set_lag(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - expected));
+    }
+}
+
+executors::executors(std::size_t executor_size, leaf::select_policy policy, bool pin)
+    : executor_size_(executor_size), policy_(policy), pin_(pin)
+{
+}
 
 executors::~executors() { shutdown(); }
 
 void executors::startup()
 {
+    auto cpus = leaf::available_cpus();
+    if (executor_size_ == 0)
+    {
+        executor_size_ = cpus.size();
+    }
+    for (const auto &c : cpus)
+    {
+        cpu_nodes_[c.cpu] = c.node;
+    }
     for (std::size_t i = 0; i < executor_size_; i++)
     {
         auto ex = std::make_shared<leaf::executors::executor>(1);
+        auto &load = leaf::executor_load::of(*ex);
+        const auto &c = cpus[i % cpus.size()];
+        load.set_node(pin_ ? c.node : -1);
+        if (policy_ != leaf::select_policy::round_robin)
+        {
+            boost::asio::co_spawn(*ex, probe_lag(load), boost::asio::detached);
+        }
+        loads_.push_back(&load);
         workers_.emplace_back(boost::asio::make_work_guard(ex->get_executor()));
-        threads_.emplace_back(worker, ex);
+        threads_.emplace_back(worker, ex, pin_ ? c.cpu : -1);
         exs_.push_back(ex);
     }
 }
@@ -31,20 +82,83 @@ void executors::shutdown()
     {
         ex->stop();
     }
-    exs_.clear();
     for (auto &&thread : threads_)
     {
         thread.join();
     }
     threads_.clear();
+    loads_.clear();
+    exs_.clear();
+}
+
+boost::asio::io_context *executors::node_executor(int cpu)
+{
+    auto it = cpu_nodes_.find(cpu);
+    if (!pin_ || it == cpu_nodes_.end())
+    {
+        return nullptr;
+    }
+    executor *ex = nullptr;
+    uint64_t score = 0;
+    for (std::size_t i = 0; i < loads_.size(); i++)
+    {
+        if (loads_[i]->node() != it->second)
+        {
+            continue;
+        }
+        auto s = loads_[i]->score();
+        if (ex == nullptr || s < score)
+        {
+            ex = exs_[i].get();
+            score = s;
+        }
+    }
+    return ex;
+}
+
+std::size_t executors::least_loaded()
+{
+    // 起点轮转, 负载相同时 (比如一批连接同时到达) 不会都落到同一个 executor
+    const std::size_t start = selected_index_.fetch_add(1, std::memory_order_relaxed) % loads_.size();
+    std::size_t index = start;
+    uint64_t score = loads_[start]->score();
+    for (std::size_t i = 1; i < loads_.size(); i++)
+    {
+        auto next = (start + i) % loads_.size();
+        auto s = loads_[next]->score();
+        if (s < score)
+        {
+            score = s;
+            index = next;
+        }
+    }
+    return index;
+}
+
+std::size_t executors::two_choices() const
+{
+    thread_local std::minstd_rand rng{std::random_device{}()};
+    std::uniform_int_distribution<std::size_t> dist(0, loads_.size() - 1);
+    auto a = dist(rng);
+    auto b = dist(rng);
+    return loads_[b]->score() < loads_[a]->score() ? b : a;
 }
 
 boost::asio::io_context &executors::get_executor()
 {
-    std::lock_guard<std::mutex> const lock(mutex_);
-    if (selected_index_ == exs_.size())
+    // exs_ 只在 startup 和 shutdown 时修改, 选择时不加锁
+    std::size_t index = 0;
+    switch (policy_)
     {
-        selected_index_ = 0;
+        case leaf::select_policy::least_loaded:
+            index = least_loaded();
+            break;
+        case leaf::select_policy::two_choices:
+            index = two_choices();
+            break;
+        default:
+            index = selected_index_.fetch_add(1, std::memory_order_relaxed) % exs_.size();
+            break;
     }
-    return *exs_[selected_index_++];
+    return *exs_[index];
 }
@@ -6,10 +6,22 @@
 #include <thread>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <unordered_map>
 #include <boost/asio.hpp>
+#include "net/executor_load.h"
 
 namespace leaf
 {
+// 新连接选择 executor 的方式, 负载见 executor_load
+enum class select_policy : uint8_t
+{
+    round_robin,
+    // 遍历所有 executor 选负载最小的
+    least_loaded,
+    // 随机取两个, 选负载小的那个
+    two_choices,
+};
 
 class executors
 {
@@ -18,19 +30,33 @@ class executors
     using executor_ptr = std::shared_ptr<executor>;
 
    public:
-    explicit executors(std::size_t executor_size);
+    // executor_size 为 0 时每个可用 cpu 一个线程, pin 为 true 时每个线程绑定一个 cpu
+    explicit executors(std::size_t executor_size, leaf::select_policy policy = leaf::select_policy::round_robin, bool pin = false);
     ~executors();
 
    public:
     void startup();
     void shutdown();
     executor &get_executor();
+    executor &get_executor(std::size_t index) { return *exs_[index]; }
+    [[nodiscard]] std::size_t size() const { return executor_size_; }
+    [[nodiscard]] const leaf::executor_load &load(std::size_t index) const { return *loads_[index]; }
+    // 与 cpu 同一个 numa 节点上负载最小的 executor, 没有绑定 cpu 或节点未知时返回 nullptr
+    executor *node_executor(int cpu);
+
+   private:
+    std::size_t least_loaded();
+    std::size_t two_choices() const;
 
    private:
     using executor_worker = boost::asio::executor_work_guard<executor::executor_type>;
-    uint32_t selected_index_ = 0;
+    std::atomic<uint32_t> selected_index_{0};
     uint32_t executor_size_ = 0;
+    leaf::select_policy policy_;
+    bool pin_ = false;
+    std::unordered_map<int, int> cpu_nodes_;
     std::mutex mutex_;
+    std::vector<leaf::executor_load *> loads_;
     std::vector<std::thread> threads_;
     std::vector<executor_ptr> exs_;
     std::vector<executor_worker> workers_;
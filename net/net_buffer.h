@@ -55,6 +55,13 @@ class write_buffer
         write_bytes(reinterpret_cast<const char*>(&val), sizeof val);
     }
 
+    // 改写已经写入的位置, 用于事后填充长度
+    void set_uint32(std::size_t pos, uint32_t x)
+    {
+        uint32_t val = host_to_network32(x);
+        ::memcpy(buffer_.data() + pos, &val, sizeof val);
+    }
+
     void write_uint16(uint16_t x)
     {
         uint16_t val = host_to_network16(x);
@@ -7,15 +7,23 @@
 namespace leaf
 {
 
-plain_websocket_client::plain_websocket_client(std::string id, std::string host, std::string port, std::string target, boost::asio::io_context& io)
-    : id_(std::move(id)), host_(std::move(host)), port_(std::move(port)), target_(std::move(target)), io_(io)
+plain_websocket_client::plain_websocket_client(
+    std::string id, std::string host, std::string port, std::string target, boost::asio::io_context& io, leaf::socket_profile profile)
+    : id_(std::move(id)),
+      host_(std::move(host)),
+      port_(std::move(port)),
+      target_(std::move(target)),
+      io_(io),
+      load_(leaf::executor_load::of(io)),
+      profile_(std::move(profile))
 {
+    load_.add_session(1);
     LOG_INFO("create {}", id_);
 }
 
 plain_websocket_client::~plain_websocket_client()
 {
-    //
+    load_.add_session(-1);
     LOG_INFO("destroy {}", id_);
 }
 boost::asio::awaitable<void> plain_websocket_client::handshake(boost::beast::error_code& ec)
@@ -29,11 +37,32 @@ boost::asio::awaitable<void> plain_websocket_client::handshake(boost::beast::err
         boost::asio::use_awaitable_t<boost::asio::any_io_executor>::as_default_on(
             boost::beast::websocket::stream<tcp_stream_limited>(co_await boost::asio::this_coro::executor)));
 
-    auto ep = co_await boost::beast::get_lowest_layer(*ws_).async_connect(results, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    // 缓冲区在 connect 之前设置, 握手时按缓冲区大小协商窗口扩大因子
+    auto& stream = boost::beast::get_lowest_layer(*ws_);
+    boost::asio::ip::tcp::endpoint ep;
+    ec = boost::asio::error::host_not_found;
+    for (const auto& entry : results)
+    {
+        boost::system::error_code ignore;
+        ignore = stream.socket().close(ignore);
+        ec = stream.socket().open(entry.endpoint().protocol(), ec);
+        if (ec)
+        {
+            continue;
+        }
+        leaf::apply_socket_buffers(stream.socket(), profile_);
+        co_await stream.async_connect(entry.endpoint(), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (!ec)
+        {
+            ep = entry.endpoint();
+            break;
+        }
+    }
     if (ec)
     {
         co_return;
     }
+    leaf::apply_socket_profile(stream.socket(), profile_);
 
     std::string host = host_ + ':' + std::to_string(ep.port());
 
@@ -55,6 +84,11 @@ boost::asio::awaitable<void> plain_websocket_client::write(boost::beast::error_c
     co_await ws_->async_write(boost::asio::buffer(data, data_size), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
 }
 
+boost::asio::awaitable<void> plain_websocket_client::write(boost::beast::error_code& ec, const std::vector<boost::asio::const_buffer>& buffers)
+{
+    co_await ws_->async_write(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+}
+
 void plain_websocket_client::close()
 {
     if (ws_ != nullptr)
@@ -63,4 +97,19 @@ void plain_websocket_client::close()
         ws_.reset();
     }
 }
+void plain_websocket_client::join_rate_group(const std::string& group)
+{
+    if (ws_ != nullptr)
+    {
+        ws_->next_layer().rate_policy().join(group);
+    }
+}
+void plain_websocket_client::apply_socket_profile(const leaf::socket_profile& profile)
+{
+    profile_ = profile;
+    if (ws_ != nullptr && ws_->next_layer().socket().is_open())
+    {
+        leaf::apply_socket_profile(ws_->next_layer().socket(), profile_);
+    }
+}
 }    // namespace leaf
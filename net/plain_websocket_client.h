@@ -9,6 +9,7 @@
 #include <boost/beast.hpp>
 #include <boost/thread/latch.hpp>
 #include "net/types.h"
+#include "net/executor_load.h"
 #include "net/websocket_session.h"
 
 namespace leaf
@@ -16,14 +17,18 @@ namespace leaf
 class plain_websocket_client : public leaf::websocket_session
 {
    public:
-    plain_websocket_client(std::string id, std::string host, std::string port, std::string target, boost::asio::io_context& io);
+    plain_websocket_client(
+        std::string id, std::string host, std::string port, std::string target, boost::asio::io_context& io, leaf::socket_profile profile = {});
     ~plain_websocket_client();
 
    public:
     boost::asio::awaitable<void> handshake(boost::beast::error_code&) override;
     boost::asio::awaitable<void> read(boost::beast::error_code&, boost::beast::flat_buffer&) override;
     boost::asio::awaitable<void> write(boost::beast::error_code&, const uint8_t*, std::size_t) override;
+    boost::asio::awaitable<void> write(boost::beast::error_code&, const std::vector<boost::asio::const_buffer>&) override;
     void close() override;
+    void join_rate_group(const std::string& group) override;
+    void apply_socket_profile(const leaf::socket_profile& profile) override;
 
    private:
     std::string id_;
@@ -31,6 +36,8 @@ class plain_websocket_client : public leaf::websocket_session
     std::string port_;
     std::string target_;
     boost::asio::io_context& io_;
+    leaf::executor_load& load_;
+    leaf::socket_profile profile_;
     bool connected_ = false;
     std::once_flag shutdown_flag_;
     boost::beast::flat_buffer buffer_;
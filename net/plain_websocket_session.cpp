@@ -13,14 +13,15 @@ namespace leaf
 plain_websocket_session::plain_websocket_session(std::string id,
                                                  tcp_stream_limited&& stream,
                                                  boost::beast::http::request<boost::beast::http::string_body> req)
-    : id_(std::move(id)), ws_(std::move(stream)), req_(std::move(req))
+    : id_(std::move(id)), ws_(std::move(stream)), req_(std::move(req)), load_(leaf::executor_load::of(ws_.get_executor()))
 {
+    load_.add_session(1);
     LOG_INFO("create {}", id_);
 }
 
 plain_websocket_session::~plain_websocket_session()
 {
-    //
+    load_.add_session(-1);
     LOG_INFO("destroy {}", id_);
 }
 boost::asio::awaitable<void> plain_websocket_session::handshake(boost::beast::error_code& ec)
@@ -45,6 +46,11 @@ boost::asio::awaitable<void> plain_websocket_session::write(boost::beast::error_
     //
     co_await ws_.async_write(boost::asio::buffer(data, data_len), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
 }
+
+boost::asio::awaitable<void> plain_websocket_session::write(boost::beast::error_code& ec, const std::vector<boost::asio::const_buffer>& buffers)
+{
+    co_await ws_.async_write(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+}
 void plain_websocket_session::close()
 {
     if (ws_.is_open())
@@ -52,5 +58,10 @@ void plain_websocket_session::close()
         boost::beast::get_lowest_layer(ws_).close();
     }
 }
+void plain_websocket_session::join_rate_group(const std::string& group) { boost::beast::get_lowest_layer(ws_).rate_policy().join(group); }
+void plain_websocket_session::apply_socket_profile(const leaf::socket_profile& profile)
+{
+    leaf::apply_socket_profile(boost::beast::get_lowest_layer(ws_).socket(), profile);
+}
 
 }    // namespace leaf
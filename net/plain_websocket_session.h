@@ -8,6 +8,7 @@
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
 #include "net/types.h"
+#include "net/executor_load.h"
 #include "net/websocket_session.h"
 
 namespace leaf
@@ -23,7 +24,10 @@ class plain_websocket_session : public leaf::websocket_session
     boost::asio::awaitable<void> handshake(boost::beast::error_code& /*unused*/) override;
     boost::asio::awaitable<void> read(boost::beast::error_code& /*unused*/, boost::beast::flat_buffer& /*unused*/) override;
     boost::asio::awaitable<void> write(boost::beast::error_code& /*unused*/, const uint8_t* /*unused*/, std::size_t /*unused*/) override;
+    boost::asio::awaitable<void> write(boost::beast::error_code& /*unused*/, const std::vector<boost::asio::const_buffer>& /*unused*/) override;
     void close() override;
+    void join_rate_group(const std::string& group) override;
+    void apply_socket_profile(const leaf::socket_profile& profile) override;
 
    private:
     std::string id_;
@@ -33,6 +37,7 @@ class plain_websocket_session : public leaf::websocket_session
     std::queue<std::vector<uint8_t>> msg_queue_;
     boost::beast::websocket::stream<tcp_stream_limited> ws_;
     boost::beast::http::request<boost::beast::http::string_body> req_;
+    leaf::executor_load& load_;
 };
 
 }    // namespace leaf
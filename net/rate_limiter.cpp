@@ -0,0 +1,212 @@
+#include <limits>
+#include <algorithm>
+#include "net/rate_limiter.h"
+
+namespace leaf
+{
+static constexpr auto kRatePeriod = std::chrono::seconds(1);
+static constexpr std::size_t kUnlimited = std::numeric_limits<std::size_t>::max();
+
+rate_limiter::rate_limiter(std::size_t rate, std::shared_ptr<rate_limiter> parent) : rate_(rate), tokens_(static_cast<double>(rate))
+{
+    set_parent(std::move(parent));
+}
+
+void rate_limiter::set_rate(std::size_t rate)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    refill(clock::now());
+    // 从不限速切换时令牌是满的
+    tokens_ = rate_ == 0 ? static_cast<double>(rate) : std::min(tokens_, static_cast<double>(rate));
+    rate_ = rate;
+}
+
+std::size_t rate_limiter::rate() const { return rate_.load(std::memory_order_relaxed); }
+
+void rate_limiter::set_parent(std::shared_ptr<rate_limiter> parent)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    parent_.store(parent.get(), std::memory_order_release);
+    if (parent)
+    {
+        parents_.push_back(std::move(parent));
+    }
+}
+
+bool rate_limiter::unlimited() const
+{
+    for (const auto* l = this; l != nullptr; l = l->parent_.load(std::memory_order_acquire))
+    {
+        if (l->rate_.load(std::memory_order_relaxed) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void rate_limiter::refill(clock::time_point now)
+{
+    auto elapsed = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    auto rate = static_cast<double>(rate_.load(std::memory_order_relaxed));
+    if (rate != 0)
+    {
+        tokens_ = std::min(rate, tokens_ + elapsed * rate);
+    }
+}
+
+std::size_t rate_limiter::available() { return share(nullptr); }
+
+std::size_t rate_limiter::share(const rate_limiter* child)
+{
+    if (unlimited())
+    {
+        return kUnlimited;
+    }
+    rate_limiter* parent = nullptr;
+    std::size_t limit = kUnlimited;
+    std::size_t count = 1;
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        auto now = clock::now();
+        refill(now);
+        if (rate_ != 0)
+        {
+            limit = tokens_ > 0 ? static_cast<std::size_t>(tokens_) : 0;
+        }
+        if (child != nullptr)
+        {
+            if (now - swept_ > kRatePeriod)
+            {
+                std::erase_if(active_, [now](const auto& kv) { return now - kv.second > kRatePeriod; });
+                swept_ = now;
+            }
+            count = active_.size() + (active_.contains(child) ? 0 : 1);
+        }
+        parent = parent_.load(std::memory_order_acquire);
+    }
+    if (parent != nullptr)
+    {
+        limit = std::min(limit, parent->share(this));
+    }
+    if (limit == kUnlimited || count == 1)
+    {
+        return limit;
+    }
+    // 平分后不足一个最小份额时允许多取, 避免小份额的连续小包
+    return std::max(limit / count, std::min<std::size_t>(limit, kRateQuantum));
+}
+
+void rate_limiter::consume(std::size_t bytes) { consume(nullptr, bytes); }
+
+void rate_limiter::consume(const rate_limiter* child, std::size_t bytes)
+{
+    if (unlimited())
+    {
+        return;
+    }
+    rate_limiter* parent = nullptr;
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        auto now = clock::now();
+        refill(now);
+        if (rate_ != 0)
+        {
+            tokens_ -= static_cast<double>(bytes);
+        }
+        if (child != nullptr)
+        {
+            active_[child] = now;
+        }
+        parent = parent_.load(std::memory_order_acquire);
+    }
+    if (parent != nullptr)
+    {
+        parent->consume(this, bytes);
+    }
+}
+
+bandwidth_scheduler::bandwidth_scheduler()
+    : read_(std::make_shared<rate_limiter>(kGlobalReadLimited)), write_(std::make_shared<rate_limiter>(kGlobalWriteLimited))
+{
+}
+
+std::pair<std::shared_ptr<rate_limiter>, std::shared_ptr<rate_limiter>> bandwidth_scheduler::group(const std::string& name)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    auto& g = groups_[name];
+    auto read = g.read.lock();
+    auto write = g.write.lock();
+    if (read && write)
+    {
+        return {read, write};
+    }
+    std::erase_if(groups_, [](const auto& kv) { return kv.second.read.expired() && kv.second.write.expired(); });
+    auto it = group_rates_.find(name);
+    auto limit = it != group_rates_.end() ? it->second : group_rate_;
+    read = std::make_shared<rate_limiter>(limit.read, read_);
+    write = std::make_shared<rate_limiter>(limit.write, write_);
+    groups_[name] = group_limiters{read, write};
+    return {read, write};
+}
+
+leaf::rate_limit bandwidth_scheduler::connection_rate() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return connection_rate_;
+}
+
+void bandwidth_scheduler::set_global_rate(const leaf::rate_limit& limit)
+{
+    read_->set_rate(limit.read);
+    write_->set_rate(limit.write);
+}
+
+void bandwidth_scheduler::set_default_group_rate(const leaf::rate_limit& limit)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    group_rate_ = limit;
+    for (auto& [name, g] : groups_)
+    {
+        if (group_rates_.contains(name))
+        {
+            continue;
+        }
+        if (auto read = g.read.lock())
+        {
+            read->set_rate(limit.read);
+        }
+        if (auto write = g.write.lock())
+        {
+            write->set_rate(limit.write);
+        }
+    }
+}
+
+void bandwidth_scheduler::set_group_rate(const std::string& name, const leaf::rate_limit& limit)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    group_rates_[name] = limit;
+    auto it = groups_.find(name);
+    if (it == groups_.end())
+    {
+        return;
+    }
+    if (auto read = it->second.read.lock())
+    {
+        read->set_rate(limit.read);
+    }
+    if (auto write = it->second.write.lock())
+    {
+        write->set_rate(limit.write);
+    }
+}
+
+void bandwidth_scheduler::set_connection_rate(const leaf::rate_limit& limit)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    connection_rate_ = limit;
+}
+
+}    // namespace leaf
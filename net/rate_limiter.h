@@ -0,0 +1,98 @@
+#ifndef LEAF_NET_RATE_LIMITER_H
+#define LEAF_NET_RATE_LIMITER_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "util/singleton.h"
+#include "config/config.h"
+
+namespace leaf
+{
+// 令牌桶, 每秒补充 rate 字节, 最多积攒一秒, rate 为 0 表示不限速
+// 子节点同时受父节点限制, 最近一秒内有传输的子节点平分父节点的令牌, 空闲子节点的份额分给其他子节点
+// 整条链都不限速时不加锁, 直接返回
+class rate_limiter
+{
+    using clock = std::chrono::steady_clock;
+
+   public:
+    explicit rate_limiter(std::size_t rate = 0, std::shared_ptr<rate_limiter> parent = nullptr);
+
+   public:
+    void set_rate(std::size_t rate);
+    [[nodiscard]] std::size_t rate() const;
+    void set_parent(std::shared_ptr<rate_limiter> parent);
+    // 本次最多可以传输的字节
+    std::size_t available();
+    void consume(std::size_t bytes);
+
+   private:
+    std::size_t share(const rate_limiter* child);
+    void consume(const rate_limiter* child, std::size_t bytes);
+    void refill(clock::time_point now);
+    [[nodiscard]] bool unlimited() const;
+
+   private:
+    mutable std::mutex mutex_;
+    std::atomic<std::size_t> rate_{0};
+    double tokens_ = 0;
+    clock::time_point last_ = clock::now();
+    std::atomic<rate_limiter*> parent_{nullptr};
+    // 设置过的父节点保留到自身释放, 不加锁读取 parent_ 时父节点一定有效
+    std::vector<std::shared_ptr<rate_limiter>> parents_;
+    // 过期的子节点每个周期清理一次, 不在每次传输时遍历
+    std::unordered_map<const rate_limiter*, clock::time_point> active_;
+    clock::time_point swept_ = clock::now();
+};
+
+struct rate_limit
+{
+    std::size_t read = 0;
+    std::size_t write = 0;
+};
+
+// 全局, 分组 (token) 和连接三级限速, 读写方向分开, 限速可以在运行中修改
+class bandwidth_scheduler
+{
+    struct group_limiters
+    {
+        std::weak_ptr<rate_limiter> read;
+        std::weak_ptr<rate_limiter> write;
+    };
+
+   public:
+    bandwidth_scheduler();
+
+   public:
+    std::shared_ptr<rate_limiter> global_read() const { return read_; }
+    std::shared_ptr<rate_limiter> global_write() const { return write_; }
+    // 分组在最后一个连接断开后释放, 单独设置过的限速保留
+    std::pair<std::shared_ptr<rate_limiter>, std::shared_ptr<rate_limiter>> group(const std::string& name);
+    [[nodiscard]] leaf::rate_limit connection_rate() const;
+    void set_global_rate(const leaf::rate_limit& limit);
+    void set_default_group_rate(const leaf::rate_limit& limit);
+    void set_group_rate(const std::string& name, const leaf::rate_limit& limit);
+    // 只影响之后建立的连接
+    void set_connection_rate(const leaf::rate_limit& limit);
+
+   private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<rate_limiter> read_;
+    std::shared_ptr<rate_limiter> write_;
+    leaf::rate_limit group_rate_{kGroupReadLimited, kGroupWriteLimited};
+    leaf::rate_limit connection_rate_{kConnectionReadLimited, kConnectionWriteLimited};
+    std::map<std::string, leaf::rate_limit> group_rates_;
+    std::map<std::string, group_limiters> groups_;
+};
+
+using bandwidth = singleton<bandwidth_scheduler>;
+
+}    // namespace leaf
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LEAF_NET_RATE_POLICY_H
+#define LEAF_NET_RATE_POLICY_H
+
+#include <string>
+#include <memory>
+#include <boost/beast/core/rate_policy.hpp>
+#include "net/rate_limiter.h"
+
+namespace leaf
+{
+// beast 的限速策略, 每个连接一对令牌桶, 登录前直接挂在全局令牌桶下
+// 令牌不足时 beast 等待一秒的定时器后重新检查
+class hierarchical_rate_policy
+{
+    friend class boost::beast::rate_policy_access;
+
+   public:
+    hierarchical_rate_policy()
+    {
+        auto& scheduler = leaf::bandwidth::instance();
+        auto limit = scheduler.connection_rate();
+        read_ = std::make_shared<leaf::rate_limiter>(limit.read, scheduler.global_read());
+        write_ = std::make_shared<leaf::rate_limiter>(limit.write, scheduler.global_write());
+    }
+
+   public:
+    // 登录后加入 token 的分组
+    void join(const std::string& group)
+    {
+        auto [read, write] = leaf::bandwidth::instance().group(group);
+        read_->set_parent(read);
+        write_->set_parent(write);
+    }
+    leaf::rate_limiter& read_limiter() { return *read_; }
+    leaf::rate_limiter& write_limiter() { return *write_; }
+
+   private:
+    std::size_t available_read_bytes() { return read_->available(); }
+    std::size_t available_write_bytes() { return write_->available(); }
+    void transfer_read_bytes(std::size_t n) { read_->consume(n); }
+    void transfer_write_bytes(std::size_t n) { write_->consume(n); }
+    void on_timer() {}
+
+   private:
+    std::shared_ptr<leaf::rate_limiter> read_;
+    std::shared_ptr<leaf::rate_limiter> write_;
+};
+
+}    // namespace leaf
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef LEAF_NET_REFLECT_BINARY_HPP
+#define LEAF_NET_REFLECT_BINARY_HPP
+
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <limits>
+
+#include "net/net_buffer.h"
+
+// REFLECT_STRUCT 的二进制编码, 字段按声明顺序排列, 没有字段名
+// 整数按类型宽度使用网络字节序, 字符串, 数组和每个结构体使用 uint32 长度前缀
+// 新字段只能追加在末尾, 解码时结构体内缺少的尾部字段保持默认值, 多出的尾部字段跳过
+// 嵌套的结构体同样适用
+namespace reflect
+{
+struct BinaryWriter
+{
+    leaf::write_buffer *m;
+    // 未结束的结构体长度字段的位置
+    std::vector<std::size_t> starts;
+
+    explicit BinaryWriter(leaf::write_buffer *m) : m(m) {}
+
+    template <typename T>
+    void integer(T v)
+    {
+        if constexpr (sizeof(T) == 1)
+        {
+            m->write_uint8(static_cast<uint8_t>(v));
+        }
+        else if constexpr (sizeof(T) == 2)
+        {
+            m->write_uint16(static_cast<uint16_t>(v));
+        }
+        else if constexpr (sizeof(T) == 4)
+        {
+            m->write_uint32(static_cast<uint32_t>(v));
+        }
+        else
+        {
+            static_assert(sizeof(T) == 8);
+            m->write_uint64(static_cast<uint64_t>(v));
+        }
+    }
+    void length(std::size_t len) { integer(static_cast<uint32_t>(len)); }
+    void string(const char *s, std::size_t len)
+    {
+        length(len);
+        m->write_bytes(s, len);
+    }
+};
+
+struct BinaryReader
+{
+    leaf::read_buffer *m;
+    bool ok = true;
+    // 未结束的结构体结束时应剩余的字节数
+    std::vector<std::size_t> ends;
+
+    explicit BinaryReader(leaf::read_buffer *m) : m(m) {}
+
+    template <typename T>
+    void integer(T &v)
+    {
+        if (!ok)
+        {
+            return;
+        }
+        if constexpr (sizeof(T) == 1)
+        {
+            uint8_t x = 0;
+            ok = m->read_uint8(&x);
+            v = static_cast<T>(x);
+        }
+        else if constexpr (sizeof(T) == 2)
+        {
+            uint16_t x = 0;
+            ok = m->read_uint16(&x);
+            v = static_cast<T>(x);
+        }
+        else if constexpr (sizeof(T) == 4)
+        {
+            uint32_t x = 0;
+            ok = m->read_uint32(&x);
+            v = static_cast<T>(x);
+        }
+        else
+        {
+            static_assert(sizeof(T) == 8);
+            uint64_t x = 0;
+            ok = m->read_uint64(&x);
+            v = static_cast<T>(x);
+        }
+    }
+    // 当前结构体内剩余的字节数
+    [[nodiscard]] std::size_t remaining() const
+    {
+        auto end = ends.empty() ? 0 : ends.back();
+        return m->size() > end ? m->size() - end : 0;
+    }
+    uint32_t length()
+    {
+        uint32_t len = 0;
+        integer(len);
+        // 长度不可能超过当前结构体的剩余数据
+        if (ok && len > remaining())
+        {
+            ok = false;
+        }
+        return ok ? len : 0;
+    }
+    void string(std::string &v)
+    {
+        auto len = length();
+        if (ok)
+        {
+            ok = m->read_string(&v, len);
+        }
+    }
+};
+
+template <typename T>
+    requires std::is_integral_v<T>
+inline void reflect(BinaryWriter &vis, T &v)
+{
+    vis.integer(v);
+}
+template <typename T>
+    requires std::is_integral_v<T>
+inline void reflect(BinaryReader &vis, T &v)
+{
+    vis.integer(v);
+}
+inline void reflect(BinaryWriter &vis, double &v)
+{
+    uint64_t x = 0;
+    ::memcpy(&x, &v, sizeof x);
+    vis.integer(x);
+}
+inline void reflect(BinaryReader &vis, double &v)
+{
+    uint64_t x = 0;
+    vis.integer(x);
+    ::memcpy(&v, &x, sizeof v);
+}
+inline void reflect(BinaryWriter &vis, std::string &v) { vis.string(v.data(), v.size()); }
+inline void reflect(BinaryReader &vis, std::string &v) { vis.string(v); }
+
+// boost optional, 1 字节标记是否有值
+template <typename T>
+void reflect(BinaryWriter &vis, boost::optional<T> &v)
+{
+    vis.integer(static_cast<uint8_t>(v.has_value() ? 1 : 0));
+    if (v)
+    {
+        reflect(vis, *v);
+    }
+}
+template <typename T>
+void reflect(BinaryReader &vis, boost::optional<T> &v)
+{
+    uint8_t has_value = 0;
+    vis.integer(has_value);
+    if (vis.ok && has_value != 0)
+    {
+        v.emplace();
+        reflect(vis, *v);
+    }
+}
+// std::vector
+template <typename T>
+inline void reflect(BinaryWriter &vis, std::vector<T> &v)
+{
+    vis.length(v.size());
+    for (auto &it : v)
+    {
+        reflect(vis, it);
+    }
+}
+template <typename T>
+inline void reflect(BinaryReader &vis, std::vector<T> &v)
+{
+    auto count = vis.length();
+    for (uint32_t i = 0; vis.ok && i < count; i++)
+    {
+        v.emplace_back();
+        reflect(vis, v.back());
+    }
+}
+
+// 结构体先写长度占位, 结束时回填
+inline void reflectMemberStart(BinaryWriter &vis)
+{
+    vis.starts.push_back(vis.m->size());
+    vis.length(0);
+}
+inline void reflectMemberEnd(BinaryWriter &vis)
+{
+    auto start = vis.starts.back();
+    vis.starts.pop_back();
+    vis.m->set_uint32(start, static_cast<uint32_t>(vis.m->size() - start - sizeof(uint32_t)));
+}
+inline void reflectMemberStart(BinaryReader &vis)
+{
+    auto len = vis.length();
+    vis.ends.push_back(vis.ok ? vis.m->size() - len : std::numeric_limits<std::size_t>::max());
+}
+inline void reflectMemberEnd(BinaryReader &vis)
+{
+    auto end = vis.ends.back();
+    vis.ends.pop_back();
+    if (!vis.ok)
+    {
+        return;
+    }
+    // 字段越过了结构体的长度
+    if (vis.m->size() < end)
+    {
+        vis.ok = false;
+        return;
+    }
+    // 新版本追加的字段
+    vis.m->consume(vis.m->size() - end);
+}
+
+template <typename T>
+inline void reflectMember(BinaryWriter &vis, const char * /*name*/, T &v)
+{
+    reflect(vis, v);
+}
+template <typename T>
+inline void reflectMember(BinaryReader &vis, const char * /*name*/, T &v)
+{
+    // 旧版本的结构体没有新追加的字段, 按当前结构体的长度判断, 不是整个消息
+    if (vis.ok && vis.remaining() != 0)
+    {
+        reflect(vis, v);
+    }
+}
+
+template <typename T>
+inline void serialize_binary(const T &t, leaf::write_buffer &w)
+{
+    using non_const_t = typename std::remove_const<T>::type;
+    auto &nt = const_cast<non_const_t &>(t);
+    BinaryWriter writer(&w);
+    reflect(writer, nt);
+}
+
+template <typename T>
+inline bool deserialize_binary(T &t, leaf::read_buffer &r)
+{
+    BinaryReader reader(&r);
+    reflect(reader, t);
+    return reader.ok;
+}
+
+}    // namespace reflect
+
+#endif
@@ -1,5 +1,6 @@
 #include <boost/system.hpp>
 
+#include "log/log.h"
 #include "net/socket.h"
 
 namespace leaf
@@ -132,14 +133,26 @@ boost::asio::ip::tcp::socket change_socket_io_context(boost::asio::ip::tcp::sock
     std::string remote = get_socket_remote_address(sock);
     boost::system::error_code ec;
     boost::asio::ip::tcp::socket tmp(io);
+    auto protocol = sock.local_endpoint(ec).protocol();
+    if (ec)
+    {
+        return tmp;
+    }
+    // release 会取消这个 socket 上挂起的操作, 调用前不能有未完成的读写
     auto fd = sock.release(ec);
     if (ec)
     {
         return tmp;
     }
-    ec = tmp.assign(boost::asio::ip::tcp::v4(), fd, ec);
+    ec = tmp.assign(protocol, fd, ec);
     if (ec)
     {
+        LOG_ERROR("change io context {} <--> {} failed {}", local, remote, ec.message());
+        // 交回原来的 io_context 关闭, 避免泄漏
+        boost::system::error_code ignore;
+        boost::asio::ip::tcp::socket closer(sock.get_executor());
+        ignore = closer.assign(protocol, fd, ignore);
+        ignore = closer.close(ignore);
         return tmp;
     }
     return tmp;
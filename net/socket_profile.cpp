@@ -0,0 +1,154 @@
+#include <atomic>
+#include <cerrno>
+#include <utility>
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+#include "log/log.h"
+#include "config/config.h"
+#include "net/socket_profile.h"
+
+namespace leaf
+{
+
+socket_profiles::socket_profiles()
+{
+    control_.no_delay = true;
+    control_.keepalive = true;
+    control_.keepalive_idle = kKeepaliveIdle;
+    control_.keepalive_interval = kKeepaliveInterval;
+    control_.keepalive_count = kKeepaliveCount;
+
+    bulk_ = control_;
+    bulk_.send_buffer = kBulkSocketBuffer;
+    bulk_.recv_buffer = kBulkSocketBuffer;
+    bulk_.notsent_lowat = kBulkNotsentLowat;
+    bulk_.congestion = kBulkCongestion;
+}
+
+leaf::socket_profile socket_profiles::control() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return control_;
+}
+
+leaf::socket_profile socket_profiles::bulk() const
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    return bulk_;
+}
+
+void socket_profiles::set_control(const leaf::socket_profile& profile)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    control_ = profile;
+}
+
+void socket_profiles::set_bulk(const leaf::socket_profile& profile)
+{
+    std::lock_guard<std::mutex> const lock(mutex_);
+    bulk_ = profile;
+}
+
+// 内核把缓冲区限制在 wmem_max / rmem_max 以内 (linux 读回的值是实际值的两倍), 读回的值小于设置的值时说明被截断
+template <typename Socket, typename Option>
+static void set_buffer(Socket& socket, const char* name, int size, std::atomic<bool>& logged)
+{
+    boost::system::error_code ec;
+    ec = socket.set_option(Option(size), ec);
+    if (ec)
+    {
+        LOG_ERROR("set {} buffer {} failed {}", name, size, ec.message());
+        return;
+    }
+    Option effective;
+    ec = socket.get_option(effective, ec);
+    // 每个连接的结果相同, 只记录一次
+    if (!ec && effective.value() < size && !logged.exchange(true))
+    {
+        LOG_ERROR("{} buffer {} clamped to {} by the kernel, raise net.core.{}mem_max or use 0 for autotuning",
+                  name,
+                  size,
+                  effective.value(),
+                  name[0] == 's' ? 'w' : 'r');
+    }
+}
+
+template <typename Socket>
+static void apply_buffers(Socket& socket, const leaf::socket_profile& profile)
+{
+    static std::atomic<bool> send_logged{false};
+    static std::atomic<bool> recv_logged{false};
+    if (profile.send_buffer > 0)
+    {
+        set_buffer<Socket, boost::asio::socket_base::send_buffer_size>(socket, "send", profile.send_buffer, send_logged);
+    }
+    if (profile.recv_buffer > 0)
+    {
+        set_buffer<Socket, boost::asio::socket_base::receive_buffer_size>(socket, "receive", profile.recv_buffer, recv_logged);
+    }
+}
+
+void apply_socket_buffers(boost::asio::ip::tcp::acceptor& acceptor, const leaf::socket_profile& profile) { apply_buffers(acceptor, profile); }
+
+void apply_socket_buffers(boost::asio::ip::tcp::socket& socket, const leaf::socket_profile& profile) { apply_buffers(socket, profile); }
+
+#ifdef __linux__
+static bool set_tcp_option(boost::asio::ip::tcp::socket& socket, int name, const void* value, socklen_t len)
+{
+    return ::setsockopt(socket.native_handle(), IPPROTO_TCP, name, value, len) == 0;
+}
+#endif
+
+void apply_socket_profile(boost::asio::ip::tcp::socket& socket, const leaf::socket_profile& profile)
+{
+    apply_buffers(socket, profile);
+    boost::system::error_code ec;
+    if (profile.no_delay)
+    {
+        ec = socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+        if (ec)
+        {
+            LOG_ERROR("set no delay failed {}", ec.message());
+        }
+    }
+    if (profile.keepalive)
+    {
+        ec = socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+        if (ec)
+        {
+            LOG_ERROR("set keepalive failed {}", ec.message());
+        }
+    }
+#ifdef __linux__
+    if (profile.keepalive)
+    {
+        const std::pair<int, int> options[] = {
+            {TCP_KEEPIDLE, profile.keepalive_idle}, {TCP_KEEPINTVL, profile.keepalive_interval}, {TCP_KEEPCNT, profile.keepalive_count}};
+        for (const auto& [name, value] : options)
+        {
+            if (value > 0 && !set_tcp_option(socket, name, &value, sizeof(value)))
+            {
+                LOG_ERROR("set keepalive option {} {} failed {}", name, value, errno);
+            }
+        }
+    }
+    if (profile.notsent_lowat > 0 && !set_tcp_option(socket, TCP_NOTSENT_LOWAT, &profile.notsent_lowat, sizeof(int)))
+    {
+        LOG_ERROR("set notsent lowat {} failed {}", profile.notsent_lowat, errno);
+    }
+    if (!profile.congestion.empty() && !set_tcp_option(socket, TCP_CONGESTION, profile.congestion.data(), profile.congestion.size()))
+    {
+        // 算法模块没有加载时每个连接都会失败, 只记录一次
+        static std::atomic<bool> logged{false};
+        if (!logged.exchange(true))
+        {
+            LOG_ERROR("set congestion control {} failed {}, using system default", profile.congestion, errno);
+        }
+    }
+#endif
+}
+
+}    // namespace leaf
@@ -0,0 +1,54 @@
+#ifndef LEAF_NET_SOCKET_PROFILE_H
+#define LEAF_NET_SOCKET_PROFILE_H
+
+#include <mutex>
+#include <string>
+#include <boost/asio.hpp>
+#include "util/singleton.h"
+
+namespace leaf
+{
+// socket 参数, 0 或空字符串表示保持系统默认
+struct socket_profile
+{
+    int send_buffer = 0;
+    int recv_buffer = 0;
+    bool no_delay = false;
+    // 内核中未发送的数据低于该值时才可写, 减少积压在 socket 里的数据
+    int notsent_lowat = 0;
+    std::string congestion;
+    bool keepalive = false;
+    int keepalive_idle = 0;    // 秒
+    int keepalive_interval = 0;
+    int keepalive_count = 0;
+};
+
+// 控制连接和批量传输连接的预设, 启动时可以修改
+class socket_profiles
+{
+   public:
+    socket_profiles();
+
+   public:
+    [[nodiscard]] leaf::socket_profile control() const;
+    [[nodiscard]] leaf::socket_profile bulk() const;
+    void set_control(const leaf::socket_profile& profile);
+    void set_bulk(const leaf::socket_profile& profile);
+
+   private:
+    mutable std::mutex mutex_;
+    leaf::socket_profile control_;
+    leaf::socket_profile bulk_;
+};
+
+using socket_presets = singleton<socket_profiles>;
+
+// 缓冲区大小决定握手时的窗口扩大因子, 需要在 listen 或 connect 之前设置, 接受的连接继承监听 socket 的设置
+void apply_socket_buffers(boost::asio::ip::tcp::acceptor& acceptor, const leaf::socket_profile& profile);
+void apply_socket_buffers(boost::asio::ip::tcp::socket& socket, const leaf::socket_profile& profile);
+// 设置失败只记录日志, 连接继续使用系统默认值
+void apply_socket_profile(boost::asio::ip::tcp::socket& socket, const leaf::socket_profile& profile);
+
+}    // namespace leaf
+
+#endif
@@ -9,12 +9,17 @@ namespace leaf
 ssl_websocket_session::ssl_websocket_session(std::string id,
                                              boost::beast::ssl_stream<tcp_stream_limited>&& stream,
                                              boost::beast::http::request<boost::beast::http::string_body> req)
-    : id_(std::move(id)), req_(std::move(req)), ws_(std::move(stream))
+    : id_(std::move(id)), req_(std::move(req)), ws_(std::move(stream)), load_(leaf::executor_load::of(ws_.get_executor()))
 {
+    load_.add_session(1);
     LOG_INFO("create {}", id_);
 }
 
-ssl_websocket_session::~ssl_websocket_session() { LOG_INFO("destroy {}", id_); }
+ssl_websocket_session::~ssl_websocket_session()
+{
+    load_.add_session(-1);
+    LOG_INFO("destroy {}", id_);
+}
 
 boost::asio::awaitable<void> ssl_websocket_session::handshake(boost::beast::error_code& ec)
 {
@@ -38,6 +43,11 @@ boost::asio::awaitable<void> ssl_websocket_session::write(boost::beast::error_co
     co_await ws_.async_write(boost::asio::buffer(data, data_len), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
 }
 
+boost::asio::awaitable<void> ssl_websocket_session::write(boost::beast::error_code& ec, const std::vector<boost::asio::const_buffer>& buffers)
+{
+    co_await ws_.async_write(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+}
+
 void ssl_websocket_session::close()
 {
     if (ws_.is_open())
@@ -46,4 +56,10 @@ void ssl_websocket_session::close()
     }
 }
 
+void ssl_websocket_session::join_rate_group(const std::string& group) { boost::beast::get_lowest_layer(ws_).rate_policy().join(group); }
+void ssl_websocket_session::apply_socket_profile(const leaf::socket_profile& profile)
+{
+    leaf::apply_socket_profile(boost::beast::get_lowest_layer(ws_).socket(), profile);
+}
+
 }    // namespace leaf
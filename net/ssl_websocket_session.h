@@ -8,6 +8,7 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/ssl/ssl_stream.hpp>
 #include "net/types.h"
+#include "net/executor_load.h"
 #include "net/websocket_session.h"
 
 namespace leaf
@@ -24,7 +25,10 @@ class ssl_websocket_session : public leaf::websocket_session
     boost::asio::awaitable<void> handshake(boost::beast::error_code& /*unused*/) override;
     boost::asio::awaitable<void> read(boost::beast::error_code& /*unused*/, boost::beast::flat_buffer& /*unused*/) override;
     boost::asio::awaitable<void> write(boost::beast::error_code& /*unused*/, const uint8_t* /*unused*/, std::size_t /*unused*/) override;
+    boost::asio::awaitable<void> write(boost::beast::error_code& /*unused*/, const std::vector<boost::asio::const_buffer>& /*unused*/) override;
     void close() override;
+    void join_rate_group(const std::string& group) override;
+    void apply_socket_profile(const leaf::socket_profile& profile) override;
 
    private:
     std::string id_;
@@ -32,6 +36,7 @@ class ssl_websocket_session : public leaf::websocket_session
     std::shared_ptr<void> self_;
     boost::beast::http::request<boost::beast::http::string_body> req_;
     boost::beast::websocket::stream<boost::beast::ssl_stream<tcp_stream_limited>> ws_;
+    leaf::executor_load& load_;
 };
 
 }    // namespace leaf
@@ -3,8 +3,8 @@
 namespace leaf
 {
 
-tcp_server::tcp_server(handle h, leaf::executors::executor& ex, boost::asio::ip::tcp::endpoint endpoint)
-    : handle_(std::move(h)), ex_(ex), endpoint_(std::move(endpoint))
+tcp_server::tcp_server(handle h, leaf::executors::executor& ex, boost::asio::ip::tcp::endpoint endpoint, bool reuse_port)
+    : handle_(std::move(h)), reuse_port_(reuse_port), ex_(ex), endpoint_(std::move(endpoint))
 {
 }
 tcp_server::~tcp_server() = default;
@@ -32,6 +32,23 @@ void tcp_server::safe_startup()
         return;
     }
 
+    if (reuse_port_)
+    {
+#ifdef SO_REUSEPORT
+        using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        ec = acceptor_.set_option(reuse_port(true), ec);
+#else
+        ec = boost::asio::error::operation_not_supported;
+#endif
+        if (ec)
+        {
+            handle_.error(ec);
+            return;
+        }
+    }
+
+    leaf::apply_socket_buffers(acceptor_, profile_);
+
     ec = acceptor_.bind(endpoint_, ec);
     if (ec)
     {
@@ -78,6 +95,8 @@ void tcp_server::on_accept(boost::beast::error_code ec)
         handle_.error(ec);
         return;
     }
+    accepted_++;
+    leaf::apply_socket_profile(socket_, profile_);
     handle_.accept(std::move(socket_));
     do_accept();
 }
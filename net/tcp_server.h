@@ -9,6 +9,7 @@
 #include <boost/asio/ssl.hpp>
 
 #include "executors.h"
+#include "net/socket_profile.h"
 
 namespace leaf
 {
@@ -26,12 +27,16 @@ class tcp_server : public std::enable_shared_from_this<tcp_server>
     };
 
    public:
-    tcp_server(handle h, leaf::executors::executor& ex, boost::asio::ip::tcp::endpoint endpoint);
+    // reuse_port 时多个 tcp_server 监听同一个端口, 由内核分配新连接
+    tcp_server(handle h, leaf::executors::executor& ex, boost::asio::ip::tcp::endpoint endpoint, bool reuse_port = false);
     ~tcp_server();
 
    public:
     void startup();
     void shutdown();
+    [[nodiscard]] uint64_t accepted() const { return accepted_; }
+    // 缓冲区设置在监听 socket 上, 其他参数在接受连接后设置, 需要在 startup 之前调用
+    void set_socket_profile(const leaf::socket_profile& profile) { profile_ = profile; }
 
    private:
     void safe_startup();
@@ -41,9 +46,12 @@ class tcp_server : public std::enable_shared_from_this<tcp_server>
 
    private:
     handle handle_;
+    bool reuse_port_ = false;
     std::atomic<bool> shutdown_{false};
+    std::atomic<uint64_t> accepted_{0};
     leaf::executors::executor& ex_;
     boost::asio::ip::tcp::endpoint endpoint_;
+    leaf::socket_profile profile_;
     boost::asio::ip::tcp::socket socket_{ex_};
     boost::asio::ip::tcp::acceptor acceptor_{ex_};
 };
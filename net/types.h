@@ -3,13 +3,14 @@
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
+#include "net/rate_policy.h"
 
 namespace leaf
 {
 using tcp_stream_unlimited =
     boost::beast::basic_stream<boost::asio::ip::tcp, boost::asio::any_io_executor, boost::beast::unlimited_rate_policy>;
 using tcp_stream_limited =
-    boost::beast::basic_stream<boost::asio::ip::tcp, boost::asio::any_io_executor, boost::beast::simple_rate_policy>;
+    boost::beast::basic_stream<boost::asio::ip::tcp, boost::asio::any_io_executor, leaf::hierarchical_rate_policy>;
 
 }    // namespace leaf
 #endif
@@ -0,0 +1,43 @@
+#ifndef LEAF_NET_WEBSOCKET_FRAME_H
+#define LEAF_NET_WEBSOCKET_FRAME_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <boost/asio/buffer.hpp>
+
+namespace leaf
+{
+// 待发送的 websocket 消息, header 为自有数据, payload 借用 holder 持有的内存 (比如文件映射)
+// 发送时 header 和 payload 作为一个 scatter/gather 写入, payload 不再拷贝
+struct websocket_frame
+{
+    websocket_frame() = default;
+    explicit websocket_frame(std::vector<uint8_t> bytes) : header(std::move(bytes)) {}
+    websocket_frame(std::vector<uint8_t> bytes, boost::asio::const_buffer data, std::shared_ptr<const void> owner)
+        : header(std::move(bytes)), payload(data), holder(std::move(owner))
+    {
+    }
+
+    [[nodiscard]] std::size_t size() const { return header.size() + payload.size(); }
+
+    [[nodiscard]] std::vector<boost::asio::const_buffer> buffers() const
+    {
+        std::vector<boost::asio::const_buffer> bufs{boost::asio::buffer(header)};
+        if (payload.size() != 0)
+        {
+            bufs.push_back(payload);
+        }
+        return bufs;
+    }
+
+    std::vector<uint8_t> header;
+    boost::asio::const_buffer payload;
+    std::shared_ptr<const void> holder;
+    // 进程内存预算的额度, frame 写完销毁时归还
+    std::shared_ptr<const void> lease;
+};
+
+}    // namespace leaf
+
+#endif
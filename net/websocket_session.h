@@ -2,10 +2,13 @@
 #define LEAF_NET_WEBSOCKET_SESSION_H
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <boost/optional.hpp>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/asio/use_awaitable.hpp>
+#include "net/socket_profile.h"
 
 namespace leaf
 {
@@ -20,9 +23,14 @@ class websocket_session : public std::enable_shared_from_this<websocket_session>
 
    public:
     virtual void close() = 0;
+    // 连接加入限速分组, 同组的连接共享分组的带宽
+    virtual void join_rate_group(const std::string& group) = 0;
+    // 升级后按连接的用途调整 socket 参数
+    virtual void apply_socket_profile(const leaf::socket_profile& profile) = 0;
     virtual boost::asio::awaitable<void> handshake(boost::beast::error_code&) = 0;
     virtual boost::asio::awaitable<void> read(boost::beast::error_code&, boost::beast::flat_buffer&) = 0;
     virtual boost::asio::awaitable<void> write(boost::beast::error_code&, const uint8_t*, std::size_t) = 0;
+    virtual boost::asio::awaitable<void> write(boost::beast::error_code&, const std::vector<boost::asio::const_buffer>&) = 0;
 };
 
 }    // namespace leaf
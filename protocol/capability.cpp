@@ -0,0 +1,117 @@
+#include <algorithm>
+#include "protocol/codec.h"
+#include "protocol/capability.h"
+
+namespace leaf
+{
+static constexpr uint64_t kLocalCapabilities = kCapBinaryCodec | kCapMultiplex | kCapStripedUpload | kCapRangedDownload | kCapResumeUpload |
+                                               kCapResumeDownload | kCapDeltaUpload | kCapDedupUpload | kCapBundleUpload | kCapAdaptiveBlock |
+                                               kCapCreditFlow;
+
+void fill_hello(leaf::login_token &hello)
+{
+    hello.version = kProtocolVersion;
+    hello.capabilities = kLocalCapabilities;
+    hello.block_size = kBlockSize;
+    hello.max_block_size = kMaxAdaptiveBlockSize;
+    hello.hash_block_count = kHashBlockCount;
+    hello.window = kDefaultWindow;
+    hello.hash = kDefaultHash;
+}
+
+leaf::login_token local_hello()
+{
+    leaf::login_token hello;
+    fill_hello(hello);
+    return hello;
+}
+
+static uint32_t pick(uint32_t local, uint32_t remote, uint32_t fallback)
+{
+    // 0 表示对端没有要求
+    if (local == 0 && remote == 0)
+    {
+        return fallback;
+    }
+    if (local == 0 || remote == 0)
+    {
+        return std::max(local, remote);
+    }
+    return std::min(local, remote);
+}
+
+leaf::session_options negotiate(const leaf::login_token &local, const leaf::login_token &remote)
+{
+    leaf::session_options options;
+    // 对端是旧版本, 使用原来的行为
+    if (local.version == 0 || remote.version == 0)
+    {
+        return options;
+    }
+    options.version = std::min(local.version, remote.version);
+    options.capabilities = local.capabilities & remote.capabilities;
+    options.block_size = std::clamp<uint32_t>(pick(local.block_size, remote.block_size, kBlockSize), kMinBlockSize, kMaxBlockSize);
+    // 数据块大小可调整时, block_size 是初始大小, hash 窗口按 block_size * hash_block_count 字节计算
+    options.max_block_size = options.block_size;
+    if (options.has(kCapAdaptiveBlock))
+    {
+        auto max_block_size = pick(local.max_block_size, remote.max_block_size, options.block_size);
+        options.max_block_size = std::clamp<uint32_t>(max_block_size, options.block_size, kMaxAdaptiveBlockSize);
+    }
+    options.hash_block_count = std::max<uint32_t>(pick(local.hash_block_count, remote.hash_block_count, kHashBlockCount), 1);
+    options.window = std::max<uint32_t>(pick(local.window, remote.window, kDefaultWindow), 1);
+    // 信用消息按 stream 分发, 依赖多路复用
+    if (!options.has(kCapMultiplex))
+    {
+        options.capabilities &= ~static_cast<uint64_t>(kCapCreditFlow);
+    }
+    // 每个 stream 在途的数据不超过 kMaxInflightBytes
+    if (options.has(kCapCreditFlow))
+    {
+        options.window = std::clamp<uint32_t>(options.window, 1, std::max<uint32_t>(kMaxInflightBytes / options.max_block_size, 1));
+    }
+    // 目前只实现了 blake2b
+    options.hash = kDefaultHash;
+    options.codec = options.has(kCapBinaryCodec) ? leaf::codec_format::binary : leaf::codec_format::json;
+    return options;
+}
+
+void apply_options(const leaf::session_options &options, leaf::login_token &reply)
+{
+    reply.version = options.version;
+    reply.capabilities = options.capabilities;
+    reply.block_size = options.block_size;
+    reply.max_block_size = options.max_block_size;
+    reply.hash_block_count = options.hash_block_count;
+    reply.window = options.window;
+    reply.hash = options.hash;
+}
+
+std::optional<leaf::peer_login> accept_login(const std::vector<uint8_t> &bytes,
+                                             const leaf::login_token &local,
+                                             leaf::session_options &options,
+                                             leaf::block_sizer *sizer,
+                                             boost::system::error_code &ec)
+{
+    auto login = leaf::get_message_type(bytes) == leaf::message_type::login ? leaf::deserialize_login_token(bytes) : std::nullopt;
+    if (!login.has_value())
+    {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return std::nullopt;
+    }
+    options = negotiate(local, login.value());
+    if (sizer != nullptr)
+    {
+        sizer->reset(options.block_size, options.has(kCapAdaptiveBlock) ? kMinBlockSize : options.block_size, options.max_block_size);
+    }
+    return leaf::peer_login{std::move(login.value()), leaf::get_message_codec(bytes)};
+}
+
+std::vector<uint8_t> login_reply(const leaf::peer_login &login, const leaf::session_options &options)
+{
+    auto reply = login.token;
+    apply_options(options, reply);
+    return leaf::serialize_login_token(reply, login.codec);
+}
+
+}    // namespace leaf
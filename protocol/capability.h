@@ -0,0 +1,104 @@
+#ifndef LEAF_PROTOCOL_CAPABILITY_H
+#define LEAF_PROTOCOL_CAPABILITY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include "config/config.h"
+#include "protocol/message.h"
+#include "file/block_sizer.h"
+
+namespace leaf
+{
+// 协议版本, 旧版本的 login_token 没有版本字段, 解码为 0
+constexpr uint32_t kProtocolVersion = 1;
+constexpr auto kDefaultHash = "blake2b";
+
+// 能力位, 双方都支持时才启用
+enum capability : uint64_t
+{
+    kCapBinaryCodec = 1ULL << 0,
+    // 消息携带 stream id, 一个连接上同时传输多个文件
+    kCapMultiplex = 1ULL << 1,
+    // 大文件拆成多个范围, 通过多个连接并发上传
+    kCapStripedUpload = 1ULL << 2,
+    // 下载请求可以指定范围, 多个连接并发下载同一个文件
+    kCapRangedDownload = 1ULL << 3,
+    // 上传中断后从服务端校验过的断点继续
+    kCapResumeUpload = 1ULL << 4,
+    // 下载时复用本地已经校验过的部分文件
+    kCapResumeDownload = 1ULL << 5,
+    // 服务端已有同名文件时只上传变化的数据
+    kCapDeltaUpload = 1ULL << 6,
+    // 上传携带整个文件的 hash, 服务端已有相同内容时不传输数据
+    kCapDedupUpload = 1ULL << 7,
+    // 多个小文件打包成一次传输
+    kCapBundleUpload = 1ULL << 8,
+    // 发送端根据带宽和 rtt 调整数据块大小, 不超过 max_block_size
+    kCapAdaptiveBlock = 1ULL << 9,
+    // 接收端写入数据后归还信用, 每个 stream 在途的数据块不超过 window
+    kCapCreditFlow = 1ULL << 10,
+};
+
+// 协商后的会话参数, 默认值即旧版本的行为
+struct session_options
+{
+    uint32_t version = 0;
+    uint64_t capabilities = 0;
+    uint32_t block_size = kBlockSize;
+    uint32_t max_block_size = kBlockSize;    // 接收端接受的最大数据块
+    uint32_t hash_block_count = kHashBlockCount;
+    uint32_t window = 0;    // 每个 stream 未归还信用的数据消息上限
+    std::string hash = kDefaultHash;
+    leaf::codec_format codec = leaf::codec_format::json;
+
+    [[nodiscard]] bool has(uint64_t cap) const { return (capabilities & cap) != 0; }
+};
+
+// 填充本端支持的版本, 能力和期望的参数
+void fill_hello(leaf::login_token &hello);
+// 只有本端参数的 login, 服务端协商时使用
+leaf::login_token local_hello();
+// 双方参数取交集, 服务端和客户端计算的结果一致
+leaf::session_options negotiate(const leaf::login_token &local, const leaf::login_token &remote);
+// 服务端把协商结果写回 login 回复
+void apply_options(const leaf::session_options &options, leaf::login_token &reply);
+
+// 对端的 login 和它使用的编码格式
+struct peer_login
+{
+    leaf::login_token token;
+    leaf::codec_format codec = leaf::codec_format::json;
+};
+
+// 解码对端的 login, 与 local 协商, sizer 不为空时按协商结果设置数据块大小的范围
+// 旧版本对端没有协商字段, 协商结果是原来的行为; 不是 login 或解码失败时 ec 为 protocol_error
+std::optional<leaf::peer_login> accept_login(const std::vector<uint8_t> &bytes,
+                                             const leaf::login_token &local,
+                                             leaf::session_options &options,
+                                             leaf::block_sizer *sizer,
+                                             boost::system::error_code &ec);
+// 服务端的回复使用客户端 login 的编码格式, 之后的消息使用协商的格式
+std::vector<uint8_t> login_reply(const leaf::peer_login &login, const leaf::session_options &options);
+
+// 客户端和服务端读取对端 login 并协商, Stream 是 websocket_session 或 plain_websocket_client
+template <typename Stream>
+boost::asio::awaitable<std::optional<leaf::peer_login>> read_login(
+    Stream &stream, const leaf::login_token &local, leaf::session_options &options, leaf::block_sizer *sizer, boost::beast::error_code &ec)
+{
+    boost::beast::flat_buffer buffer;
+    co_await stream.read(ec, buffer);
+    if (ec)
+    {
+        co_return std::nullopt;
+    }
+    const auto *data = static_cast<const uint8_t *>(buffer.data().data());
+    co_return leaf::accept_login(std::vector<uint8_t>(data, data + buffer.size()), local, options, sizer, ec);
+}
+
+}    // namespace leaf
+
+#endif
@@ -2,19 +2,26 @@
 #include <type_traits>
 #include "protocol/codec.h"
 #include "net/reflect.hpp"
+#include "net/reflect_binary.hpp"
 #include "net/net_buffer.h"
+#include "config/config.h"
 
 namespace reflect
 {
 REFLECT_STRUCT(leaf::create_dir, (dir)(token));
 REFLECT_STRUCT(leaf::keepalive, (id)(client_id)(client_timestamp)(server_timestamp));
 REFLECT_STRUCT(leaf::login_request, (username)(password));
-REFLECT_STRUCT(leaf::login_token, (id)(token));
+REFLECT_STRUCT(leaf::login_token, (id)(token)(version)(capabilities)(block_size)(hash_block_count)(window)(hash)(max_block_size));
 REFLECT_STRUCT(leaf::error_message, (id)(error));
-REFLECT_STRUCT(leaf::upload_file_request, (id)(filesize)(filename));
-REFLECT_STRUCT(leaf::upload_file_response, (id)(filename));
-REFLECT_STRUCT(leaf::download_file_response, (id)(filesize)(filename));
-REFLECT_STRUCT(leaf::download_file_request, (id)(filename));
+REFLECT_STRUCT(leaf::upload_file_request, (id)(filesize)(filename)(offset)(length)(delta)(hash));
+REFLECT_STRUCT(leaf::delta_block, (weak)(strong));
+REFLECT_STRUCT(leaf::upload_file_response, (id)(filename)(offset)(delta_block_size)(signature)(deduplicated));
+REFLECT_STRUCT(leaf::delta_copy, (index)(count));
+REFLECT_STRUCT(leaf::bundle_entry, (filename)(filesize)(hash));
+REFLECT_STRUCT(leaf::bundle_request, (id)(files));
+REFLECT_STRUCT(leaf::credit, (count));
+REFLECT_STRUCT(leaf::download_file_response, (id)(filesize)(filename)(offset)(length));
+REFLECT_STRUCT(leaf::download_file_request, (id)(filename)(offset)(length)(hashes));
 REFLECT_STRUCT(leaf::delete_file_request, (id)(filename));
 REFLECT_STRUCT(leaf::file_node, (parent)(name)(type));
 REFLECT_STRUCT(leaf::files_request, (token)(dir));
@@ -25,15 +32,45 @@ namespace leaf
 {
 static uint16_t to_underlying(leaf::message_type type) { return static_cast<std::underlying_type_t<leaf::message_type>>(type); }
 
-static void write_padding(leaf::write_buffer &w)
+// padding 的高 32 位为 stream id, 低字节标记消息体的编码格式
+static void write_padding(leaf::write_buffer &w, leaf::codec_format format = leaf::codec_format::json)
 {
-    uint64_t xx = 0;
+    uint64_t xx = static_cast<uint8_t>(format);
     w.write_uint64(xx);
 }
-static void read_padding(leaf::read_buffer &r)
+static leaf::codec_format read_padding(leaf::read_buffer &r)
 {
     uint64_t xx = 0;
     r.read_uint64(&xx);
+    return static_cast<leaf::codec_format>(xx & 0xff);
+}
+
+template <typename T>
+static void write_body(leaf::write_buffer &w, const T &msg, leaf::codec_format format)
+{
+    if (format == leaf::codec_format::binary)
+    {
+        reflect::serialize_binary(msg, w);
+        return;
+    }
+    std::string str = reflect::serialize_struct(msg);
+    w.write_bytes(str.data(), str.size());
+}
+
+template <typename T>
+static bool read_body(leaf::read_buffer &r, T &msg, leaf::codec_format format)
+{
+    if (format == leaf::codec_format::binary)
+    {
+        return reflect::deserialize_binary(msg, r);
+    }
+    std::string str;
+    r.read_string(&str, r.size());
+    if (str.empty())
+    {
+        return false;
+    }
+    return reflect::deserialize_struct(msg, str);
 }
 
 leaf::message_type get_message_type(std::string_view data)
@@ -56,13 +93,48 @@ leaf::message_type get_message_type(const std::vector<uint8_t> &data)
     return static_cast<leaf::message_type>(type);
 }
 
-std::vector<uint8_t> serialize_upload_file_request(const upload_file_request &msg)
+leaf::message_type get_message_type(std::span<const uint8_t> data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    read_padding(r);
+    uint16_t type = 0;
+    r.read_uint16(&type);
+    return static_cast<leaf::message_type>(type);
+}
+
+leaf::codec_format get_message_codec(std::span<const uint8_t> data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    return read_padding(r);
+}
+
+uint32_t get_message_stream(std::span<const uint8_t> data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    uint64_t xx = 0;
+    r.read_uint64(&xx);
+    return static_cast<uint32_t>(xx >> 32);
+}
+
+void set_message_stream(std::vector<uint8_t> &bytes, uint32_t stream)
+{
+    if (bytes.size() < sizeof(uint64_t))
+    {
+        return;
+    }
+    // padding 是网络字节序, 高 32 位在前 4 个字节
+    bytes[0] = static_cast<uint8_t>(stream >> 24);
+    bytes[1] = static_cast<uint8_t>(stream >> 16);
+    bytes[2] = static_cast<uint8_t>(stream >> 8);
+    bytes[3] = static_cast<uint8_t>(stream);
+}
+
+std::vector<uint8_t> serialize_upload_file_request(const upload_file_request &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::upload_file_request));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -74,7 +146,7 @@ std::optional<leaf::upload_file_request> deserialize_upload_file_request(const s
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
 
     uint16_t type = 0;
     r.read_uint16(&type);
@@ -82,28 +154,20 @@ std::optional<leaf::upload_file_request> deserialize_upload_file_request(const s
     {
         return {};
     }
-
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::upload_file_request req;
-    if (!reflect::deserialize_struct(req, str))
+    if (!read_body(r, req, format))
     {
         return {};
     }
     return req;
 }
 // response
-std::vector<uint8_t> serialize_upload_file_response(const upload_file_response &msg)
+std::vector<uint8_t> serialize_upload_file_response(const upload_file_response &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::upload_file_response));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -111,78 +175,162 @@ std::vector<uint8_t> serialize_upload_file_response(const upload_file_response &
 std::optional<leaf::upload_file_response> deserialize_upload_file_response(const std::vector<uint8_t> &data)
 {
     leaf::read_buffer r(data.data(), data.size());
-    if (r.size() > 2048)
+    // 增量上传的回复携带签名
+    if (r.size() > kReadWsLimited)
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::upload_file_response))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
+    leaf::upload_file_response resp;
+    if (!read_body(r, resp, format))
     {
         return {};
     }
-    leaf::upload_file_response resp;
-    if (!reflect::deserialize_struct(resp, str))
+    return resp;
+}
+
+std::vector<uint8_t> serialize_delta_copy(const delta_copy &msg, leaf::codec_format format)
+{
+    leaf::write_buffer w;
+    write_padding(w, format);
+    w.write_uint16(leaf::to_underlying(message_type::delta_copy));
+    write_body(w, msg, format);
+    std::vector<uint8_t> bytes;
+    w.copy_to(&bytes);
+    return bytes;
+}
+std::optional<leaf::delta_copy> deserialize_delta_copy(const std::vector<uint8_t> &data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    if (r.size() > 2048)
     {
         return {};
     }
-    return resp;
+    auto format = read_padding(r);
+    uint16_t type = 0;
+    r.read_uint16(&type);
+    if (type != leaf::to_underlying(message_type::delta_copy))
+    {
+        return {};
+    }
+    leaf::delta_copy c;
+    if (!read_body(r, c, format))
+    {
+        return {};
+    }
+    return c;
 }
 
-std::vector<uint8_t> serialize_error_message(const error_message &msg)
+std::vector<uint8_t> serialize_bundle_request(const bundle_request &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
-    w.write_uint16(leaf::to_underlying(message_type::error));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_padding(w, format);
+    w.write_uint16(leaf::to_underlying(message_type::bundle_request));
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
 }
+std::optional<leaf::bundle_request> deserialize_bundle_request(const std::vector<uint8_t> &data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    // 清单包含每个文件的名称和 hash
+    if (r.size() > kReadWsLimited)
+    {
+        return {};
+    }
+    auto format = read_padding(r);
+    uint16_t type = 0;
+    r.read_uint16(&type);
+    if (type != leaf::to_underlying(message_type::bundle_request))
+    {
+        return {};
+    }
+    leaf::bundle_request req;
+    if (!read_body(r, req, format))
+    {
+        return {};
+    }
+    return req;
+}
 
-std::optional<leaf::error_message> deserialize_error_message(const std::vector<uint8_t> &data)
+std::vector<uint8_t> serialize_credit(const credit &msg, leaf::codec_format format)
+{
+    leaf::write_buffer w;
+    write_padding(w, format);
+    w.write_uint16(leaf::to_underlying(message_type::credit));
+    write_body(w, msg, format);
+    std::vector<uint8_t> bytes;
+    w.copy_to(&bytes);
+    return bytes;
+}
+std::optional<leaf::credit> deserialize_credit(std::span<const uint8_t> data)
 {
     leaf::read_buffer r(data.data(), data.size());
     if (r.size() > 2048)
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
-    if (type != leaf::to_underlying(message_type::error))
+    if (type != leaf::to_underlying(message_type::credit))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
+    leaf::credit c;
+    if (!read_body(r, c, format))
+    {
+        return {};
+    }
+    return c;
+}
+
+std::vector<uint8_t> serialize_error_message(const error_message &msg, leaf::codec_format format)
+{
+    leaf::write_buffer w;
+    write_padding(w, format);
+    w.write_uint16(leaf::to_underlying(message_type::error));
+    write_body(w, msg, format);
+    std::vector<uint8_t> bytes;
+    w.copy_to(&bytes);
+    return bytes;
+}
+
+std::optional<leaf::error_message> deserialize_error_message(const std::vector<uint8_t> &data)
+{
+    leaf::read_buffer r(data.data(), data.size());
+    if (r.size() > 2048)
+    {
+        return {};
+    }
+    auto format = read_padding(r);
+    uint16_t type = 0;
+    r.read_uint16(&type);
+    if (type != leaf::to_underlying(message_type::error))
     {
         return {};
     }
     leaf::error_message req;
-    if (!reflect::deserialize_struct(req, str))
+    if (!read_body(r, req, format))
     {
         return {};
     }
     return req;
 }
 
-std::vector<uint8_t> serialize_download_file_request(const download_file_request &msg)
+std::vector<uint8_t> serialize_download_file_request(const download_file_request &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::download_file_request));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -190,38 +338,32 @@ std::vector<uint8_t> serialize_download_file_request(const download_file_request
 std::optional<leaf::download_file_request> deserialize_download_file_request(const std::vector<uint8_t> &data)
 {
     leaf::read_buffer r(data.data(), data.size());
-    if (r.size() > 2048)
+    // 续传请求携带本地文件的窗口 hash
+    if (r.size() > kReadWsLimited)
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::download_file_request))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::download_file_request req;
-    if (!reflect::deserialize_struct(req, str))
+    if (!read_body(r, req, format))
     {
         return {};
     }
     return req;
 }
 
-std::vector<uint8_t> serialize_download_file_response(const download_file_response &msg)
+std::vector<uint8_t> serialize_download_file_response(const download_file_response &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::download_file_response));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -233,31 +375,27 @@ std::optional<leaf::download_file_response> deserialize_download_file_response(c
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::download_file_response))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
+    leaf::download_file_response resp;
+    if (!read_body(r, resp, format))
     {
         return {};
     }
-    leaf::download_file_response resp;
-    reflect::deserialize_struct(resp, str);
     return resp;
 }
 
-std::vector<uint8_t> serialize_delete_file_request(const delete_file_request &msg)
+std::vector<uint8_t> serialize_delete_file_request(const delete_file_request &msg, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::delete_file_request));
-    std::string str = reflect::serialize_struct(msg);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, msg, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -270,34 +408,27 @@ std::optional<leaf::delete_file_request> deserialize_delete_file_request(const s
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::delete_file_request))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::delete_file_request req;
-    if (!reflect::deserialize_struct(req, str))
+    if (!read_body(r, req, format))
     {
         return {};
     }
     return req;
 }
 
-std::vector<uint8_t> serialize_keepalive(const leaf::keepalive &k)
+std::vector<uint8_t> serialize_keepalive(const leaf::keepalive &k, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::keepalive));
-    std::string str = reflect::serialize_struct(k);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, k, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -309,33 +440,26 @@ std::optional<leaf::keepalive> deserialize_keepalive_response(const std::vector<
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::keepalive))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::keepalive resp;
-    if (!reflect::deserialize_struct(resp, str))
+    if (!read_body(r, resp, format))
     {
         return {};
     }
     return resp;
 }
-std::vector<uint8_t> serialize_login_request(const leaf::login_request &l)
+std::vector<uint8_t> serialize_login_request(const leaf::login_request &l, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::login));
-    std::string str = reflect::serialize_struct(l);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, l, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -348,35 +472,27 @@ std::optional<leaf::login_request> deserialize_login_request(const std::vector<u
         return {};
     }
 
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::login))
     {
         return {};
     }
-
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::login_request l;
-    if (!reflect::deserialize_struct(l, str))
+    if (!read_body(r, l, format))
     {
         return {};
     }
     return l;
 }
 
-std::vector<uint8_t> serialize_login_token(const leaf::login_token &l)
+std::vector<uint8_t> serialize_login_token(const leaf::login_token &l, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::login));
-    std::string str = reflect::serialize_struct(l);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, l, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -390,35 +506,27 @@ std::optional<leaf::login_token> deserialize_login_token(const std::vector<uint8
         return {};
     }
 
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::login))
     {
         return {};
     }
-
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::login_token l;
-    if (!reflect::deserialize_struct(l, str))
+    if (!read_body(r, l, format))
     {
         return {};
     }
     return l;
 }
 
-std::vector<uint8_t> serialize_files_request(const leaf::files_request &f)
+std::vector<uint8_t> serialize_files_request(const leaf::files_request &f, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::files_request));
-    std::string str = reflect::serialize_struct(f);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, f, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -431,34 +539,27 @@ std::optional<leaf::files_request> deserialize_files_request(const std::vector<u
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::files_request))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::files_request f;
-    if (!reflect::deserialize_struct(f, str))
+    if (!read_body(r, f, format))
     {
         return {};
     }
     return f;
 }
 
-std::vector<uint8_t> serialize_files_response(const leaf::files_response &f)
+std::vector<uint8_t> serialize_files_response(const leaf::files_response &f, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::files_response));
-    std::string str = reflect::serialize_struct(f);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, f, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -471,47 +572,51 @@ std::optional<leaf::files_response> deserialize_files_response(const std::vector
     {
         return {};
     }
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::files_response))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::files_response f;
-    if (!reflect::deserialize_struct(f, str))
+    if (!read_body(r, f, format))
     {
         return {};
     }
     return f;
 }
 
-std::vector<uint8_t> serialize_file_data(const file_data &data)
+std::vector<uint8_t> serialize_file_data_header(const std::string &hash, uint32_t data_size)
 {
     leaf::write_buffer w;
     write_padding(w);
     w.write_uint16(leaf::to_underlying(message_type::file_data));
-    uint32_t data_size = data.data.size();
-    uint32_t hash_size = data.hash.size();
+    uint32_t hash_size = hash.size();
     w.write_uint32(hash_size);
     w.write_uint32(data_size);
     if (hash_size > 0)
     {
-        w.write_bytes(data.hash.data(), hash_size);
+        w.write_bytes(hash.data(), hash_size);
     }
-    w.write_bytes(data.data);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
 }
 
-std::optional<file_data> deserialize_file_data(const std::vector<uint8_t> &data)
+std::vector<uint8_t> serialize_file_data(const file_data &data)
+{
+    auto bytes = serialize_file_data_header(data.hash, data.data.size());
+    bytes.insert(bytes.end(), data.data.begin(), data.data.end());
+    return bytes;
+}
+
+leaf::websocket_frame serialize_file_data(const std::string &hash, boost::asio::const_buffer data, std::shared_ptr<const void> holder)
+{
+    return {serialize_file_data_header(hash, static_cast<uint32_t>(data.size())), data, std::move(holder)};
+}
+
+std::optional<file_data_view> deserialize_file_data_view(std::span<const uint8_t> data)
 {
     leaf::read_buffer r(data.data(), data.size());
     read_padding(r);
@@ -523,16 +628,31 @@ std::optional<file_data> deserialize_file_data(const std::vector<uint8_t> &data)
     }
     uint32_t hash_size = 0;
     uint32_t data_size = 0;
-    r.read_uint32(&hash_size);
-    r.read_uint32(&data_size);
-    file_data fd;
-    if (hash_size > 0)
+    if (!r.read_uint32(&hash_size) || !r.read_uint32(&data_size))
+    {
+        return {};
+    }
+    if (r.size() < static_cast<std::size_t>(hash_size) + data_size)
     {
-        fd.hash.assign(hash_size, 0);
-        r.read_bytes(fd.hash.data(), hash_size);
+        return {};
     }
-    fd.data.assign(data_size, 0);
-    r.read_bytes(fd.data.data(), data_size);
+    auto offset = data.size() - r.size();
+    file_data_view view;
+    view.hash = std::string_view(reinterpret_cast<const char *>(data.data() + offset), hash_size);
+    view.data = data.subspan(offset + hash_size, data_size);
+    return view;
+}
+
+std::optional<file_data> deserialize_file_data(const std::vector<uint8_t> &data)
+{
+    auto view = deserialize_file_data_view(data);
+    if (!view.has_value())
+    {
+        return {};
+    }
+    file_data fd;
+    fd.hash.assign(view->hash);
+    fd.data.assign(view->data.begin(), view->data.end());
     return fd;
 }
 
@@ -579,13 +699,12 @@ std::optional<leaf::done> deserialize_done(const std::vector<uint8_t> &data)
     }
     return leaf::done{};
 }
-std::vector<uint8_t> serialize_create_dir(const create_dir &c)
+std::vector<uint8_t> serialize_create_dir(const create_dir &c, leaf::codec_format format)
 {
     leaf::write_buffer w;
-    write_padding(w);
+    write_padding(w, format);
     w.write_uint16(leaf::to_underlying(message_type::dir));
-    std::string str = reflect::serialize_struct(c);
-    w.write_bytes(str.data(), str.size());
+    write_body(w, c, format);
     std::vector<uint8_t> bytes;
     w.copy_to(&bytes);
     return bytes;
@@ -593,21 +712,15 @@ std::vector<uint8_t> serialize_create_dir(const create_dir &c)
 std::optional<leaf::create_dir> deserialize_create_dir(const std::vector<uint8_t> &data)
 {
     leaf::read_buffer r(data.data(), data.size());
-    read_padding(r);
+    auto format = read_padding(r);
     uint16_t type = 0;
     r.read_uint16(&type);
     if (type != leaf::to_underlying(message_type::dir))
     {
         return {};
     }
-    std::string str;
-    r.read_string(&str, r.size());
-    if (str.empty())
-    {
-        return {};
-    }
     leaf::create_dir c;
-    if (!reflect::deserialize_struct(c, str))
+    if (!read_body(r, c, format))
     {
         return {};
     }
@@ -5,31 +5,43 @@
 #include <cstdint>
 #include <string_view>
 #include "protocol/message.h"
+#include "net/websocket_frame.h"
 
 namespace leaf
 {
 leaf::message_type get_message_type(const std::string &data);
 leaf::message_type get_message_type(std::string_view data);
 leaf::message_type get_message_type(const std::vector<uint8_t> &data);
-std::vector<uint8_t> serialize_keepalive(const leaf::keepalive &k);
-std::vector<uint8_t> serialize_error_message(const error_message &msg);
-std::vector<uint8_t> serialize_login_request(const leaf::login_request &l);
-std::vector<uint8_t> serialize_login_token(const leaf::login_token &l);
-std::vector<uint8_t> serialize_files_request(const leaf::files_request &f);
-std::vector<uint8_t> serialize_files_response(const leaf::files_response &f);
-std::vector<uint8_t> serialize_upload_file_request(const upload_file_request &msg);
-std::vector<uint8_t> serialize_upload_file_response(const upload_file_response &msg);
-std::vector<uint8_t> serialize_download_file_request(const download_file_request &msg);
-std::vector<uint8_t> serialize_download_file_response(const download_file_response &msg);
-std::vector<uint8_t> serialize_delete_file_request(const delete_file_request &msg);
+leaf::message_type get_message_type(std::span<const uint8_t> data);
+// 未协商时使用 json, 旧版本服务端只能解析 json
+std::vector<uint8_t> serialize_keepalive(const leaf::keepalive &k, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_error_message(const error_message &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_login_request(const leaf::login_request &l, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_login_token(const leaf::login_token &l, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_files_request(const leaf::files_request &f, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_files_response(const leaf::files_response &f, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_upload_file_request(const upload_file_request &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_upload_file_response(const upload_file_response &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_delta_copy(const delta_copy &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_bundle_request(const bundle_request &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_credit(const credit &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_download_file_request(const download_file_request &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_download_file_response(const download_file_response &msg, leaf::codec_format format = leaf::codec_format::json);
+std::vector<uint8_t> serialize_delete_file_request(const delete_file_request &msg, leaf::codec_format format = leaf::codec_format::json);
 std::vector<uint8_t> serialize_file_data(const file_data &data);
+std::vector<uint8_t> serialize_file_data_header(const std::string &hash, uint32_t data_size);
+// 零拷贝编码, data 指向 holder 持有的内存, 发送完成前保持有效
+leaf::websocket_frame serialize_file_data(const std::string &hash, boost::asio::const_buffer data, std::shared_ptr<const void> holder);
 std::vector<uint8_t> serialize_ack(const ack &a);
 std::vector<uint8_t> serialize_done(const done &d);
-std::vector<uint8_t> serialize_create_dir(const create_dir &c);
+std::vector<uint8_t> serialize_create_dir(const create_dir &c, leaf::codec_format format = leaf::codec_format::json);
 
 std::optional<leaf::error_message> deserialize_error_message(const std::vector<uint8_t> &data);
 std::optional<leaf::upload_file_request> deserialize_upload_file_request(const std::vector<uint8_t> &data);
 std::optional<leaf::upload_file_response> deserialize_upload_file_response(const std::vector<uint8_t> &data);
+std::optional<leaf::delta_copy> deserialize_delta_copy(const std::vector<uint8_t> &data);
+std::optional<leaf::bundle_request> deserialize_bundle_request(const std::vector<uint8_t> &data);
+std::optional<leaf::credit> deserialize_credit(std::span<const uint8_t> data);
 std::optional<leaf::download_file_request> deserialize_download_file_request(const std::vector<uint8_t> &data);
 std::optional<leaf::download_file_response> deserialize_download_file_response(const std::vector<uint8_t> &data);
 std::optional<leaf::delete_file_request> deserialize_delete_file_request(const std::vector<uint8_t> &data);
@@ -39,6 +51,12 @@ std::optional<leaf::login_token> deserialize_login_token(const std::vector<uint8
 std::optional<leaf::files_request> deserialize_files_request(const std::vector<uint8_t> &data);
 std::optional<leaf::files_response> deserialize_files_response(const std::vector<uint8_t> &data);
 std::optional<leaf::file_data> deserialize_file_data(const std::vector<uint8_t> &data);
+std::optional<leaf::file_data_view> deserialize_file_data_view(std::span<const uint8_t> data);
+// 消息体的编码格式, 服务端按客户端使用的格式回复
+leaf::codec_format get_message_codec(std::span<const uint8_t> data);
+// 多路复用时消息所属的 stream, 0 表示连接本身
+uint32_t get_message_stream(std::span<const uint8_t> data);
+void set_message_stream(std::vector<uint8_t> &bytes, uint32_t stream);
 std::optional<leaf::ack> deserialize_ack(const std::vector<uint8_t> &data);
 std::optional<leaf::done> deserialize_done(const std::vector<uint8_t> &data);
 std::optional<leaf::create_dir> deserialize_create_dir(const std::vector<uint8_t> &data);
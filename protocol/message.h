@@ -1,9 +1,11 @@
 #ifndef LEAF_PROTOCOL_MESSAGE_H
 #define LEAF_PROTOCOL_MESSAGE_H
 
+#include <span>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <string_view>
 
 namespace leaf
 {
@@ -24,6 +26,16 @@ enum class message_type : uint8_t
     ack = 12,
     done = 13,
     dir = 14,
+    delta_copy = 15,
+    bundle_request = 16,
+    credit = 17,
+};
+
+// 控制消息体的编码格式, json 用于调试
+enum class codec_format : uint8_t
+{
+    json = 0,
+    binary = 1,
 };
 
 struct create_dir
@@ -42,6 +54,14 @@ struct login_token
 {
     uint32_t id = 0;
     std::string token;
+    // 以下字段用于能力协商, 旧版本没有这些字段, 解码后保持默认值
+    uint32_t version = 0;             // 协议版本
+    uint64_t capabilities = 0;        // 能力位
+    uint32_t block_size = 0;          // 数据块大小
+    uint32_t hash_block_count = 0;    // 每个 hash 窗口的块数
+    uint32_t window = 0;              // 未确认的数据块上限
+    std::string hash;                 // hash 算法
+    uint32_t max_block_size = 0;      // 可以接受的最大数据块
 };
 
 struct files_request
@@ -66,6 +86,11 @@ struct files_response
 struct ack
 {
 };
+// 接收端归还的信用, 所属的 stream 在 padding 中
+struct credit
+{
+    uint32_t count = 0;
+};
 struct done
 {
 };
@@ -75,17 +100,57 @@ struct upload_file_request
     uint32_t id = 0;
     uint64_t filesize = 0;
     std::string filename;
+    // 分段上传, length 为 0 表示整个文件
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    bool delta = false;    // 服务端已有同名文件时使用增量上传
+    std::string hash;      // 整个文件的 blake2b, 用于内容去重
+};
+// 增量上传的签名, 服务端已有文件的一个块
+struct delta_block
+{
+    uint32_t weak = 0;     // 滚动校验和
+    std::string strong;    // blake2b
 };
 struct upload_file_response
 {
     uint32_t id = 0;
     std::string filename;
+    uint64_t offset = 0;    // 断点续传, 客户端从这个位置继续发送
+    // 增量上传, block_size 为 0 时客户端发送完整的文件
+    uint32_t delta_block_size = 0;
+    std::vector<delta_block> signature;
+    bool deduplicated = false;    // 服务端已有相同内容, 不需要发送数据
+};
+// 打包上传的清单, 之后的 file_data 按清单顺序连续携带所有文件的内容
+struct bundle_entry
+{
+    std::string filename;
+    uint64_t filesize = 0;
+    std::string hash;    // 整个文件的 blake2b
+};
+struct bundle_request
+{
+    uint32_t id = 0;
+    std::vector<bundle_entry> files;
+};
+// 增量上传, 把服务端已有文件的 [index, index + count) 块复制到当前位置
+struct delta_copy
+{
+    uint64_t index = 0;
+    uint32_t count = 0;
 };
 struct file_data
 {
     std::string hash;
     std::vector<uint8_t> data;
 };
+// file_data 的只读视图, 指向接收缓冲区, 缓冲区 consume 之前有效
+struct file_data_view
+{
+    std::string_view hash;
+    std::span<const uint8_t> data;
+};
 struct error_message
 {
     uint32_t id = 0;
@@ -104,6 +169,10 @@ struct download_file_request
 {
     uint32_t id = 0;
     std::string filename;    // 文件名称
+    uint64_t offset = 0;     // 下载范围的起始位置
+    uint64_t length = 0;     // 下载范围的长度, 0 表示到文件结尾
+    // 本地已有的数据, 从文件开头每个 hash 窗口的 blake2b, 服务端从第一个不一致的窗口开始发送
+    std::vector<std::string> hashes;
 };
 
 struct download_file_response
@@ -111,6 +180,8 @@ struct download_file_response
     uint32_t id = 0;
     uint64_t filesize = 0;
     std::string filename;    // 文件名称
+    uint64_t offset = 0;     // 服务端实际发送的范围
+    uint64_t length = 0;     // 整个文件时为 0
 };
 
 struct delete_file_request
@@ -1,28 +1,121 @@
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/co_spawn.hpp>
 #include "log/log.h"
 #include "net/socket.h"
+#include "net/cpu_topology.h"
+#include "net/socket_profile.h"
 #include "net/tcp_server.h"
 #include "net/session_handle.h"
 #include "net/detect_session.h"
 #include "server/application.h"
 #include "file/file_http_handle.h"
+#include "file/memory_governor.h"
+#include "file/file.h"
+#include "file/content_index.h"
+#include "file/disk_executors.h"
 
 namespace leaf
 {
+// 在磁盘线程上清理内容索引, 目录较大时遍历耗时, 不在主线程执行
+static boost::asio::awaitable<void> reclaim_content_coro()
+{
+    auto objects = leaf::make_file_path(leaf::kObjectsDir);
+    boost::system::error_code ec;
+    auto count = co_await leaf::dio::instance().run(objects, [&ec]() { return leaf::reclaim_content(ec); });
+    if (ec)
+    {
+        LOG_ERROR("reclaim content objects error {}", ec.message());
+    }
+    if (count != 0)
+    {
+        LOG_INFO("reclaim content objects {}", count);
+    }
+}
 
 application::application(int argc, char *argv[]) : argc_(argc), argv_(argv) {}
 
 application::~application() = default;
 
-void application::startup()
+bool application::parse_command_line()
 {
-    uint16_t listen_port = 8080;
-    if (argc_ > 1)
+    std::string select;
+    boost::program_options::options_description desc("Allowed options");
+    // clang-format off
+    desc.add_options()("help,h", "Show help message")(
+        "port,p", boost::program_options::value<uint16_t>(&listen_port_)->default_value(8080), "Listen port")(
+        "reuse-port", boost::program_options::bool_switch(&reuse_port_), "One SO_REUSEPORT acceptor per executor thread")(
+        "select", boost::program_options::value<std::string>(&select)->default_value("two_choices"), "round_robin, least_loaded or two_choices")(
+        "threads", boost::program_options::value<std::size_t>(&threads_)->default_value(0), "Executor threads, 0 for one per available cpu")(
+        "pin", boost::program_options::bool_switch(&pin_), "Pin each executor thread to a cpu, spread over numa nodes")(
+        "socket-buffer", boost::program_options::value<int>(), "Send and receive buffer of bulk connections, 0 for autotuning")(
+        "congestion", boost::program_options::value<std::string>(), "Congestion control of bulk connections, empty for system default");
+    // clang-format on
+    // 兼容旧的用法, 第一个参数是端口
+    boost::program_options::positional_options_description pos;
+    pos.add("port", 1);
+    boost::program_options::variables_map vm;
+    try
+    {
+        boost::program_options::store(boost::program_options::command_line_parser(argc_, argv_).options(desc).positional(pos).run(), vm);
+        boost::program_options::notify(vm);
+    }
+    catch (const boost::program_options::error& e)
+    {
+        std::cerr << e.what() << "\n" << desc << "\n";
+        return false;
+    }
+    if (vm.count("help") != 0U)
+    {
+        std::cerr << desc << "\n";
+        return false;
+    }
+    auto bulk = leaf::socket_presets::instance().bulk();
+    if (vm.count("socket-buffer") != 0U)
     {
-        listen_port = std::atoi(argv_[1]);
+        bulk.send_buffer = vm["socket-buffer"].as<int>();
+        bulk.recv_buffer = bulk.send_buffer;
     }
+    if (vm.count("congestion") != 0U)
+    {
+        bulk.congestion = vm["congestion"].as<std::string>();
+    }
+    leaf::socket_presets::instance().set_bulk(bulk);
+    if (select == "round_robin")
+    {
+        select_policy_ = leaf::select_policy::round_robin;
+    }
+    else if (select == "least_loaded")
+    {
+        select_policy_ = leaf::select_policy::least_loaded;
+    }
+    else if (select == "two_choices")
+    {
+        select_policy_ = leaf::select_policy::two_choices;
+    }
+    else
+    {
+        std::cerr << "unknown select policy " << select << "\n" << desc << "\n";
+        return false;
+    }
+    return true;
+}
 
-    LOG_INFO("listen port {}", listen_port);
-    endpoint_ = boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), listen_port);
+uint64_t application::accepted() const
+{
+    uint64_t count = 0;
+    for (const auto& server : servers_)
+    {
+        count += server->accepted();
+    }
+    return count;
+}
+
+void application::startup()
+{
+    LOG_INFO("listen port {} reuse port {}", listen_port_, reuse_port_);
+    endpoint_ = boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), listen_port_);
 
     leaf::session_handle h2;
     h2.http_handle = leaf::http_handle;
@@ -34,31 +127,65 @@ void application::startup()
         std::string local_addr = leaf::get_socket_local_address(socket);
         std::string remote_addr = leaf::get_socket_remote_address(socket);
         LOG_INFO("new socket local {} remote {}", local_addr, remote_addr);    // NOLINT
+        // 连接交给与收包 cpu 同一个 numa 节点的 executor, 还没有读写, 可以直接更换 io_context
+        auto* io = executors_->node_executor(leaf::socket_incoming_cpu(socket));
+        if (io != nullptr && leaf::executor_load::of(*io).node() != leaf::executor_load::of(socket.get_executor()).node())
+        {
+            socket = leaf::change_socket_io_context(std::move(socket), *io);
+        }
         std::make_shared<leaf::detect_session>(std::move(socket), ssl_ctx_, h2)->startup();
     };
 
-    h.socket = [this]
-    {
-        //
-        return boost::asio::ip::tcp::socket(executors_->get_executor());
-    };
-    h.error = [this](boost::beast::error_code ec)
+    // 监听出错时停止接受连接, 在 io 线程上调用 shutdown 会等待自己
+    h.error = [](boost::beast::error_code ec)
     {
         //
-        LOG_ERROR("socket error", ec.message());    // NOLINT
-        server_->shutdown();
+        LOG_ERROR("socket error {}", ec.message());    // NOLINT
     };
 
-    server_ = std::make_shared<leaf::tcp_server>(h, executors_->get_executor(), endpoint_);
-    server_->startup();
+    if (reuse_port_)
+    {
+        // 内核在各个监听之间分配连接, 连接留在接受它的线程上
+        for (std::size_t i = 0; i < executors_->size(); i++)
+        {
+            // 按下标取, 选择策略可能把多个监听放到同一个 executor
+            auto& ex = executors_->get_executor(i);
+            h.socket = [&ex] { return boost::asio::ip::tcp::socket(ex); };
+            servers_.push_back(std::make_shared<leaf::tcp_server>(h, ex, endpoint_, true));
+        }
+    }
+    else
+    {
+        h.socket = [this]
+        {
+            //
+            return boost::asio::ip::tcp::socket(executors_->get_executor());
+        };
+        servers_.push_back(std::make_shared<leaf::tcp_server>(h, executors_->get_executor(), endpoint_));
+    }
+    // 连接的用途在升级时才知道, 监听 socket 使用批量传输的缓冲区, 接受后先按控制连接设置
+    auto profile = leaf::socket_presets::instance().control();
+    auto bulk = leaf::socket_presets::instance().bulk();
+    profile.send_buffer = bulk.send_buffer;
+    profile.recv_buffer = bulk.recv_buffer;
+    for (const auto& server : servers_)
+    {
+        server->set_socket_profile(profile);
+        server->startup();
+    }
 }
 
 int application::exec()
 {
+    if (!parse_command_line())
+    {
+        return -1;
+    }
     leaf::init_log("cmd.log");
     leaf::set_log_level("trace");
-    executors_ = new leaf::executors(4);
+    executors_ = new leaf::executors(threads_, select_policy_, pin_);
     executors_->startup();
+    LOG_INFO("executors {} pin {}", executors_->size(), pin_);
     {
         std::atomic<bool> stop{false};
         boost::asio::signal_set sig(executors_->get_executor());
@@ -77,9 +204,38 @@ int application::exec()
         LOG_INFO("start");
         startup();
         //
+        std::size_t high_water = 0;
+        uint64_t last_accepted = 0;
+        auto last_report = std::chrono::steady_clock::now();
+        auto last_reclaim = last_report;
         while (!stop)
         {
             std::this_thread::sleep_for(std::chrono::milliseconds(30));
+            // 每秒输出一次接受连接的速率, 用于比较两种监听方式
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_report >= std::chrono::seconds(1))
+            {
+                auto count = accepted();
+                if (count != last_accepted)
+                {
+                    auto seconds = std::chrono::duration<double>(now - last_report).count();
+                    LOG_INFO("accept rate {:.1f}/s total {} reuse port {}", static_cast<double>(count - last_accepted) / seconds, count, reuse_port_);
+                }
+                last_accepted = count;
+                last_report = now;
+            }
+            if (now - last_reclaim >= leaf::kContentReclaimInterval)
+            {
+                last_reclaim = now;
+                boost::asio::co_spawn(executors_->get_executor(), reclaim_content_coro(), boost::asio::detached);
+            }
+            // 发送缓冲的占用创新高时输出
+            auto& m = leaf::mem::instance();
+            if (m.high_water() != high_water)
+            {
+                high_water = m.high_water();
+                LOG_INFO("memory usage {} high water {} budget {}", m.usage(), high_water, m.budget());
+            }
         }
         //
 
@@ -96,8 +252,11 @@ int application::exec()
 
 void application::shutdown()
 {
-    server_->shutdown();
-    server_.reset();
+    for (const auto& server : servers_)
+    {
+        server->shutdown();
+    }
+    servers_.clear();
 }
 
 }    // namespace leaf
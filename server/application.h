@@ -1,6 +1,7 @@
 #ifndef LEAF_SERVER_APPLICATION_H
 #define LEAF_SERVER_APPLICATION_H
 
+#include <vector>
 #include "net/tcp_server.h"
 
 namespace leaf
@@ -15,15 +16,23 @@ class application
     int exec();
 
    private:
+    bool parse_command_line();
     void startup();
     void shutdown();
+    [[nodiscard]] uint64_t accepted() const;
 
    private:
     int argc_ = 0;
     char** argv_ = nullptr;
+    uint16_t listen_port_ = 8080;
+    bool reuse_port_ = false;
+    bool pin_ = false;
+    std::size_t threads_ = 0;
+    leaf::select_policy select_policy_ = leaf::select_policy::two_choices;
     leaf::executors* executors_ = nullptr;
     boost::asio::ip::tcp::endpoint endpoint_;
-    std::shared_ptr<leaf::tcp_server> server_;
+    // reuse_port 时每个 executor 一个, 否则只有一个
+    std::vector<std::shared_ptr<leaf::tcp_server>> servers_;
     boost::asio::ssl::context ssl_ctx_{boost::asio::ssl::context::tls_server};
 };
 }    // namespace leaf